@@ -0,0 +1,322 @@
+/**
+ * Stage 1 Micro-Benchmark
+ *
+ * Purpose: Measure RuleEngine Stage 1 cost on a real input, check that
+ *          optimized code paths produce the same results as the reference,
+ *          and compare every tokenizer x matcher x scorer specialization.
+ *
+ * Compile: make bench
+ * Run: ./bench_stage1 subset_500.csv 200
+ */
+
+#define SCENARIO_D_NO_MAIN
+#include "scenario_d.cpp"
+
+// ============================================================================
+// Reference Implementation (libc tokenizer, two-pass classify + calculateConfidence)
+// ============================================================================
+
+static KeywordList referenceTokenize(const string& content) {
+    KeywordList keywords;
+    string word;
+    auto flush = [&]() {
+        if (word.length() > 2) keywords.emplace_back(word);
+        word.clear();
+    };
+    for (char c : content) {
+        unsigned char uc = static_cast<unsigned char>(c);
+        if (isspace(uc)) {
+            flush();
+        } else if (isalnum(uc)) {
+            word.push_back(static_cast<char>(tolower(uc)));
+        }
+    }
+    flush();
+    sort(keywords.begin(), keywords.end());
+    keywords.erase(unique(keywords.begin(), keywords.end()), keywords.end());
+    if (keywords.size() > 10) keywords.resize(10);
+    return keywords;
+}
+
+static string referenceClassify(const map<string, set<string>>& label_rules,
+                                const KeywordList& keywords,
+                                const string& level) {
+    map<string, int> scores;
+    for (const auto& [label, rules] : label_rules) {
+        int score = 0;
+        for (const auto& kw : keywords) {
+            for (const auto& rule : rules) {
+                if (kw.find(rule) != string::npos ||
+                    rule.find(kw) != string::npos) {
+                    score++;
+                }
+            }
+        }
+        scores[label] = score;
+    }
+
+    string best_label = "-";
+    int max_score = 0;
+    for (const auto& [label, score] : scores) {
+        if (score > max_score) {
+            max_score = score;
+            best_label = label;
+        }
+    }
+
+    if (max_score <= 1 && level == "INFO") {
+        return "-";
+    }
+    return best_label;
+}
+
+static string referenceConfidence(const map<string, set<string>>& label_rules,
+                                  const KeywordList& keywords,
+                                  const string& label) {
+    if (label == "-") {
+        for (const auto& [lbl, rules] : label_rules) {
+            for (const auto& kw : keywords) {
+                for (const auto& rule : rules) {
+                    if (kw.find(rule) != string::npos) return "low";
+                }
+            }
+        }
+        return "high";
+    }
+
+    int match_count = 0;
+    if (label_rules.count(label)) {
+        for (const auto& kw : keywords) {
+            for (const auto& rule : label_rules.at(label)) {
+                if (kw.find(rule) != string::npos) {
+                    match_count++;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (match_count >= 3) return "high";
+    if (match_count >= 1) return "medium";
+    return "low";
+}
+
+// ============================================================================
+// Main Program
+// ============================================================================
+
+// Tokenize and classify cost of one engine variant, plus its agreement
+// with the reference on every row
+struct VariantResult {
+    double tokenize_ns = 0;
+    double classify_ns = 0;
+    int keyword_mismatches = 0;
+    int label_mismatches = 0;
+};
+
+static VariantResult benchVariant(RuleEngine& engine, const vector<LogEntry>& logs,
+                                  const vector<KeywordList>& ref_keywords,
+                                  const vector<pair<string, string>>& ref_results,
+                                  int iterations, size_t& sink) {
+    VariantResult r;
+    RowArena arena;
+    
+    for (size_t i = 0; i < logs.size(); i++) {
+        KeywordList kws = engine.extractKeywords(logs[i].content, arena);
+        if (kws != ref_keywords[i]) r.keyword_mismatches++;
+        arena.reset();
+        ClassifyResult res = engine.classify(ref_keywords[i], logs[i].level);
+        if (res.label != ref_results[i].first || res.confidence != ref_results[i].second) {
+            r.label_mismatches++;
+        }
+    }
+    
+    auto tok_start = chrono::high_resolution_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < logs.size(); i++) {
+            sink += engine.extractKeywords(logs[i].content, arena).size();
+            arena.reset();
+        }
+    }
+    auto tok_end = chrono::high_resolution_clock::now();
+    
+    auto cls_start = chrono::high_resolution_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < logs.size(); i++) {
+            ClassifyResult res = engine.classify(ref_keywords[i], logs[i].level);
+            sink += res.label.size() + res.confidence.size();
+        }
+    }
+    auto cls_end = chrono::high_resolution_clock::now();
+    
+    double rows = (double)logs.size() * iterations;
+    r.tokenize_ns = chrono::duration<double, nano>(tok_end - tok_start).count() / rows;
+    r.classify_ns = chrono::duration<double, nano>(cls_end - cls_start).count() / rows;
+    return r;
+}
+
+int main(int argc, char* argv[]) {
+    string input_file = "subset_500.csv";
+    int iterations = 200;
+
+    if (argc > 1) input_file = argv[1];
+    if (argc > 2) iterations = stoi(argv[2]);
+
+    vector<LogEntry> logs = loadCSV(input_file);
+    if (logs.empty()) {
+        cerr << "No logs loaded. Exiting." << endl;
+        return 1;
+    }
+
+    unique_ptr<RuleEngine> default_engine = makeRuleEngine(kDefaultRuleEngine);
+    RuleEngine& engine = *default_engine;
+    const auto& rules = engine.rules();
+    
+    // The merged classify + confidence pass on its own, without the token cache
+    unique_ptr<RuleEngine> scan_engine = makeRuleEngine("span-scan-count");
+
+    // Reference keywords come from the libc tokenizer
+    vector<KeywordList> keywords;
+    keywords.reserve(logs.size());
+    for (size_t i = 0; i < logs.size(); i++) {
+        keywords.push_back(referenceTokenize(logs[i].content));
+    }
+
+    // Correctness: both variants must agree on every row
+    int mismatches = 0;
+    for (size_t i = 0; i < logs.size(); i++) {
+        string ref_label = referenceClassify(rules, keywords[i], logs[i].level);
+        string ref_conf = referenceConfidence(rules, keywords[i], ref_label);
+        ClassifyResult res = engine.classify(keywords[i], logs[i].level);
+        if (res.label != ref_label || res.confidence != ref_conf) {
+            if (mismatches < 10) {
+                cerr << "Mismatch at LineId " << logs[i].line_id << ": "
+                     << ref_label << "/" << ref_conf << " vs "
+                     << res.label << "/" << res.confidence << endl;
+            }
+            mismatches++;
+        }
+    }
+    
+    // The INFO fast path may only claim rows the reference settles as "-"/"high"
+    for (size_t i = 0; i < logs.size(); i++) {
+        auto matches = engine.matchKeywords(keywords[i], pmr::get_default_resource());
+        if (!engine.isQuietInfo(matches, logs[i].level)) continue;
+        string ref_label = referenceClassify(rules, keywords[i], logs[i].level);
+        string ref_conf = referenceConfidence(rules, keywords[i], ref_label);
+        if (ref_label != "-" || ref_conf != "high") {
+            if (mismatches < 10) {
+                cerr << "Fast path mismatch at LineId " << logs[i].line_id << ": "
+                     << ref_label << "/" << ref_conf << endl;
+            }
+            mismatches++;
+        }
+    }
+
+    // Timing
+    size_t sink = 0;
+
+    auto ref_start = chrono::high_resolution_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < logs.size(); i++) {
+            string label = referenceClassify(rules, keywords[i], logs[i].level);
+            sink += label.size() + referenceConfidence(rules, keywords[i], label).size();
+        }
+    }
+    auto ref_end = chrono::high_resolution_clock::now();
+
+    auto new_start = chrono::high_resolution_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < logs.size(); i++) {
+            ClassifyResult res = scan_engine->classify(keywords[i], logs[i].level);
+            sink += res.label.size() + res.confidence.size();
+        }
+    }
+    auto new_end = chrono::high_resolution_clock::now();
+    
+    auto cached_start = chrono::high_resolution_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < logs.size(); i++) {
+            ClassifyResult res = engine.classify(keywords[i], logs[i].level);
+            sink += res.label.size() + res.confidence.size();
+        }
+    }
+    auto cached_end = chrono::high_resolution_clock::now();
+    
+    // Stage 1 as the pipeline runs it: tokenize, match, then either the
+    // INFO fast path or the scorer
+    vector<LogEntry> analyzed = logs;
+    RowArena arena;
+    auto analyze_start = chrono::high_resolution_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (auto& log : analyzed) {
+            engine.analyze(log, arena);
+            arena.reset();
+            sink += log.predicted_label.size() + log.confidence.size();
+        }
+    }
+    auto analyze_end = chrono::high_resolution_clock::now();
+    
+    // Fast path counter from a real pipeline run
+    vector<LogEntry> segment = logs;
+    ReportGenerator report_gen;
+    vector<ThreadAggregates> aggregates(omp_get_max_threads());
+    PipelineContext ctx{engine, report_gen, aggregates, nullptr, nullptr};
+    ctx.progress = false;
+    processSegment(segment, ctx, 0);
+    StatsAccumulator acc;
+    acc.add(segment);
+
+    double rows = (double)logs.size() * iterations;
+    double ref_ns = chrono::duration<double, nano>(ref_end - ref_start).count() / rows;
+    double new_ns = chrono::duration<double, nano>(new_end - new_start).count() / rows;
+    double cached_ns = chrono::duration<double, nano>(cached_end - cached_start).count() / rows;
+    double analyze_ns = chrono::duration<double, nano>(analyze_end - analyze_start).count() / rows;
+
+    cout << "\n" << string(80, '=') << endl;
+    cout << "STAGE 1 BENCHMARK" << endl;
+    cout << string(80, '=') << endl;
+    cout << "Rows: " << logs.size() << " x " << iterations << " iterations" << endl;
+    cout << "\n--- Classify + Confidence ---" << endl;
+    cout << "Two-pass (reference): " << fixed << setprecision(1) << ref_ns << " ns/row" << endl;
+    cout << "One-pass (scan):      " << fixed << setprecision(1) << new_ns << " ns/row" << endl;
+    cout << "One-pass + cache:     " << fixed << setprecision(1) << cached_ns << " ns/row" << endl;
+    cout << "Speedup: " << fixed << setprecision(2) << ref_ns / new_ns << "x (one-pass), "
+         << new_ns / cached_ns << "x (token cache on top)" << endl;
+    cout << "\n--- Stage 1 (analyze) ---" << endl;
+    cout << "Tokenize + classify:  " << fixed << setprecision(1) << analyze_ns << " ns/row" << endl;
+    cout << "INFO fast path: " << acc.fast_path << "/" << acc.total_logs 
+         << " rows (processSegment)" << endl;
+    cout << "Token cache: " << engine.cachedTokens() << " distinct keywords" << endl;
+    
+    // Every tokenizer x matcher x scorer specialization
+    vector<pair<string, string>> ref_results;
+    for (size_t i = 0; i < logs.size(); i++) {
+        string label = referenceClassify(rules, keywords[i], logs[i].level);
+        ref_results.emplace_back(label, referenceConfidence(rules, keywords[i], label));
+    }
+    cout << "\n--- Engine Variants (ns/row) ---" << endl;
+    cout << left << setw(24) << "Variant" << right << setw(10) << "Tokenize" 
+         << setw(10) << "Classify" << setw(10) << "Total" << "  Vs reference" << endl;
+    for (const auto& variant : ruleEngineVariants()) {
+        unique_ptr<RuleEngine> candidate = variant.make();
+        VariantResult r = benchVariant(*candidate, logs, keywords, ref_results, iterations, sink);
+        cout << left << setw(24) << variant.name << right << fixed << setprecision(1)
+             << setw(10) << r.tokenize_ns << setw(10) << r.classify_ns 
+             << setw(10) << r.tokenize_ns + r.classify_ns << "  ";
+        if (r.keyword_mismatches > 0) {
+            cout << r.keyword_mismatches << " keyword mismatches" << endl;
+            mismatches += r.keyword_mismatches;
+        } else if (variant.exact) {
+            cout << (r.label_mismatches == 0 ? "exact" : to_string(r.label_mismatches) + " mismatches") << endl;
+            mismatches += r.label_mismatches;
+        } else {
+            cout << r.label_mismatches << " rows differ" << endl;
+        }
+    }
+    
+    cout << "\nMismatches: " << mismatches << " (checksum " << sink << ")" << endl;
+    cout << string(80, '=') << endl;
+
+    return mismatches == 0 ? 0 : 1;
+}
@@ -25,14 +25,13 @@ echo "Loading modules..."
 module load gcc/11.2.0
 module list
 
-# Set OpenMP environment
-export OMP_NUM_THREADS=$SLURM_CPUS_PER_TASK
+# Set OpenMP environment (the thread count is detected from the
+# allocation: affinity mask, cgroup quota, SLURM_CPUS_PER_TASK, SMT)
 export OMP_PROC_BIND=true
 export OMP_PLACES=cores
 
 echo ""
 echo "OpenMP Configuration:"
-echo "  OMP_NUM_THREADS=$OMP_NUM_THREADS"
 echo "  OMP_PROC_BIND=$OMP_PROC_BIND"
 echo "  OMP_PLACES=$OMP_PLACES"
 
@@ -63,7 +62,7 @@ echo ""
 echo "========================================"
 echo "Running Scenario D..."
 echo "========================================"
-time ./scenario_d subset_500.csv output/ $SLURM_CPUS_PER_TASK
+time ./scenario_d subset_500.csv output/ auto
 
 # Check if execution succeeded
 if [ $? -eq 0 ]; then
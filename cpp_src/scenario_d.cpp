@@ -6,21 +6,56 @@
  * 
  * Compile: make
  * Run: ./scenario_d data/subset_500.csv output/ 32
+ *      ./scenario_d huge.csv output/ 32 --memory-limit 512
+ *      ./scenario_d huge.csv output/ 32 --checkpoint [--resume]
+ *      ./scenario_d huge.csv output/ 32 --dedup
+ *      ./scenario_d huge.csv output/ auto --calibrate
+ *      ./scenario_d serve /tmp/scenario_d.sock output/ 32
+ *      ./scenario_d client /tmp/scenario_d.sock data/subset_500.csv --batch 100
+ *      ./scenario_d listen 127.0.0.1 output/ 32 --udp 5514 --tcp 5514 --store
+ *      ./scenario_d loggen udp 127.0.0.1 5514 data/subset_500.csv --rate 50000
+ *      ./scenario_d query output/ keyword=parity rack=R36
+ *      ./scenario_d query output/ severity=FATAL group by node top 20
  */
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <deque>
 #include <string>
+#include <string_view>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <functional>
 #include <omp.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -28,6 +63,45 @@ using namespace std;
 // Data Structures
 // ============================================================================
 
+enum Severity : uint8_t {
+    SEV_INFO,
+    SEV_WARNING,
+    SEV_ERROR,
+    SEV_CRITICAL,
+    SEV_COUNT
+};
+
+static const char* const kSeverityNames[SEV_COUNT] = {
+    "INFO", "WARNING", "ERROR", "CRITICAL"
+};
+
+// Why CSVReader rejected a row (see scenario_d_quarantine.csv)
+enum ParseError : uint8_t {
+    PARSE_BAD_LINE_ID,
+    PARSE_LINE_ID_RANGE,
+    PARSE_UNTERMINATED_QUOTE,
+    PARSE_MISSING_COLUMNS,
+    PARSE_ERROR_COUNT
+};
+
+static const char* const kParseErrorNames[PARSE_ERROR_COUNT] = {
+    "bad_line_id", "line_id_out_of_range", "unterminated_quote", "missing_columns"
+};
+
+struct ParseErrorCounts {
+    long counts[PARSE_ERROR_COUNT] = {};
+    
+    long total() const {
+        long n = 0;
+        for (long c : counts) n += c;
+        return n;
+    }
+    
+    void merge(const ParseErrorCounts& other) {
+        for (int r = 0; r < PARSE_ERROR_COUNT; r++) counts[r] += other.counts[r];
+    }
+};
+
 struct LogEntry {
     int line_id;
     string label;              // Ground truth
@@ -38,12 +112,19 @@ struct LogEntry {
     string component;
     string level;
     string content;
+    string event_id;
     string event_template;
+    int64_t unix_time = -1;     // parsed Timestamp (-1 = missing)
+    uint16_t topology = 0;      // packed node location, see decodeNode()
     
     // Analysis results
     string predicted_label;
     string confidence;
     string severity_level;
+    uint8_t predicted_label_id = 0;   // index into RuleEngine::labelNames()
+    uint8_t severity_id = SEV_INFO;
+    bool fast_path = false;           // settled by the INFO prefilter
+    bool deduplicated = false;        // Stage 1 results copied from an identical row
     vector<string> keywords;
     string affected_component;
     string issue_category;
@@ -54,6 +135,11 @@ struct LogEntry {
     double total_time_ms;
 };
 
+// Predicted as a problem or logged above INFO
+inline bool isProblemRow(const LogEntry& log) {
+    return log.predicted_label_id != 0 || log.severity_id != SEV_INFO;
+}
+
 struct PerformanceStats {
     int total_logs;
     int num_threads;
@@ -64,47 +150,556 @@ struct PerformanceStats {
     double avg_time_per_log_ms;
     double stage1_percentage;
     double stage2_percentage;
+    
+    // Prediction accuracy (only reported when rows carry a ground-truth Label)
+    bool has_ground_truth;
     int correct_predictions;
     double accuracy_percentage;
+    long fast_path_rows;
+    double fast_path_percentage;
+    
+    // Rows rejected by the CSV reader, by reason
+    ParseErrorCounts parse_errors;
+    
+    // Content deduplication (only reported with --dedup)
+    bool has_dedup;
+    long unique_messages;
+    double dedup_ratio;
     double avg_keywords_count;
     double avg_keywords_chars;
     long peak_memory_mb;
+    
+    // Cardinality estimates (HyperLogLog, 0 when disabled)
+    bool has_distinct_counts;
+    double distinct_nodes;
+    double distinct_components;
+    double distinct_node_templates;
+    double distinct_keywords;
+};
+
+// ============================================================================
+// Character Classes
+// ============================================================================
+
+// Byte classes for tokenization, fixed at compile time. Unlike isalnum()
+// and tolower() they ignore the locale, cost one load per byte and are
+// defined for every byte value, including negative chars.
+enum CharClass : uint8_t {
+    CH_SPACE = 1,      // C-locale isspace: ' ', \t, \n, \v, \f, \r
+    CH_DIGIT = 2,
+    CH_ALPHA = 4,      // ASCII letters only
+    CH_ALNUM = CH_DIGIT | CH_ALPHA
+};
+
+struct CharTables {
+    uint8_t classes[256] = {};
+    char lower[256] = {};
+};
+
+constexpr CharTables makeCharTables() {
+    CharTables t;
+    for (int c = 0; c < 256; c++) {
+        t.lower[c] = (char)(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+        if (c == ' ' || (c >= '\t' && c <= '\r')) t.classes[c] = CH_SPACE;
+        else if (c >= '0' && c <= '9') t.classes[c] = CH_DIGIT;
+        else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) t.classes[c] = CH_ALPHA;
+    }
+    return t;
+}
+
+static constexpr CharTables kCharTables = makeCharTables();
+
+inline uint8_t charClass(char c) { return kCharTables.classes[(unsigned char)c]; }
+inline bool isSpaceChar(char c) { return charClass(c) & CH_SPACE; }
+inline bool isDigitChar(char c) { return charClass(c) & CH_DIGIT; }
+inline bool isAlnumChar(char c) { return charClass(c) & CH_ALNUM; }
+inline char lowerChar(char c) { return kCharTables.lower[(unsigned char)c]; }
+
+// True if no byte has the high bit set. Tests eight bytes per step; the
+// compiler vectorizes the OR-reduction.
+inline bool isAscii(const char* p, size_t n) {
+    uint64_t high = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        high |= word;
+    }
+    for (; i < n; i++) high |= (unsigned char)p[i];
+    return (high & 0x8080808080808080ULL) == 0;
+}
+
+// Unicode white space outside ASCII (NEL, NBSP, the U+2000 block, ...)
+inline bool isUnicodeSpace(uint32_t cp) {
+    return cp == 0x85 || cp == 0xA0 || cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200A) ||
+           cp == 0x2028 || cp == 0x2029 || cp == 0x202F || cp == 0x205F || cp == 0x3000;
+}
+
+// Length of the well-formed UTF-8 sequence at `p` and its code point, or 0
+// for a stray or truncated byte
+inline size_t decodeUtf8(const unsigned char* p, const unsigned char* end, uint32_t& cp) {
+    size_t len = p[0] >= 0xF0 && p[0] <= 0xF4 ? 4 : p[0] >= 0xE0 ? 3 : p[0] >= 0xC2 ? 2 : 0;
+    if (len == 0 || p[0] >= 0xF5 || (size_t)(end - p) < len) return 0;
+    cp = p[0] & (0x7F >> len);
+    for (size_t i = 1; i < len; i++) {
+        if ((p[i] & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    // Reject overlong forms, surrogates and values past U+10FFFF
+    static const uint32_t kMinCodePoint[5] = {0, 0, 0x80, 0x800, 0x10000};
+    if (cp < kMinCodePoint[len] || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) return 0;
+    return len;
+}
+
+// Drives a tokenizer over `content`: emit(c) for every keyword character
+// (ASCII alphanumerics, lowercased) and flush() at every word break. ASCII
+// rows take the table-only loop. Rows with other bytes are decoded as
+// UTF-8 so Unicode spaces also break words; every other non-ASCII code
+// point or malformed byte is dropped like punctuation.
+template <typename Emit, typename Flush>
+inline void scanWords(const string& content, Emit emit, Flush flush) {
+    if (isAscii(content.data(), content.size())) {
+        for (char c : content) {
+            uint8_t cls = charClass(c);
+            if (cls & CH_SPACE) {
+                flush();
+            } else if (cls & CH_ALNUM) {
+                emit(lowerChar(c));
+            }
+        }
+        return;
+    }
+    
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(content.data());
+    const unsigned char* end = p + content.size();
+    while (p < end) {
+        if (*p < 0x80) {
+            uint8_t cls = charClass((char)*p);
+            if (cls & CH_SPACE) {
+                flush();
+            } else if (cls & CH_ALNUM) {
+                emit(lowerChar((char)*p));
+            }
+            p++;
+            continue;
+        }
+        uint32_t cp;
+        size_t len = decodeUtf8(p, end, cp);
+        if (len > 0 && isUnicodeSpace(cp)) flush();
+        p += len > 0 ? len : 1;
+    }
+}
+
+// ============================================================================
+// Per-Thread Arena
+// ============================================================================
+
+// Bump allocator for per-row temporaries. Each worker thread owns one, so
+// the hot loop never goes through malloc and never contends on its arenas.
+class RowArena {
+private:
+    static constexpr size_t kInitialBytes = 64 * 1024;
+    
+    unique_ptr<char[]> buffer;
+    pmr::monotonic_buffer_resource pool;
+    
+public:
+    RowArena()
+        : buffer(new char[kInitialBytes]),
+          pool(buffer.get(), kInitialBytes) {}
+    
+    RowArena(const RowArena&) = delete;
+    RowArena& operator=(const RowArena&) = delete;
+    
+    pmr::memory_resource* resource() { return &pool; }
+    
+    // Drops everything allocated since the last reset. Rows that overflowed
+    // the initial buffer fall back to the heap, which is freed here too.
+    void reset() { pool.release(); }
 };
 
+using ArenaString = pmr::string;
+using KeywordList = pmr::vector<ArenaString>;
+
 // ============================================================================
 // Rule Engine (Stage 1)
 // ============================================================================
 
-class RuleEngine {
+struct ClassifyResult {
+    string label;
+    string confidence;
+    int label_id;               // 0 = normal ("-")
+};
+
+static const char* const kCategoryNames[] = {
+    "General", "Configuration", "Performance", "Connectivity"
+};
+
+// Everything Stage 1 derives from one distinct keyword. Row results are
+// sums and ORs of these, so a keyword is matched against the rules once.
+struct TokenMatch {
+    static constexpr size_t kMaxLabels = 16;
+    
+    uint8_t scores[kMaxLabels] = {};   // per label: rules matched in either direction
+    uint16_t hit_labels = 0;           // labels with a rule inside the keyword
+    uint8_t category = 0;              // kCategoryNames index, 0 = General
+};
+
+// Sharded keyword -> TokenMatch map shared by all worker threads. Readers
+// take a shard's shared lock; a miss is computed outside the lock and
+// published under the exclusive one. Entries are copied out, so a shard
+// that fills up can simply be cleared. Lookups go by string_view with the
+// hash computed once, so a hit allocates nothing.
+class TokenCache {
 private:
-    map<string, set<string>> label_rules;
+    static constexpr size_t kShards = 64;
+    static constexpr size_t kMaxPerShard = 16 * 1024;
+    
+    // Map keys view into the shard's `keys`; the hash picks the shard and
+    // the bucket
+    struct Key {
+        string_view text;
+        size_t hash;
+        bool operator==(const Key& other) const { return text == other.text; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return key.hash; }
+    };
+    
+    struct Shard {
+        shared_mutex mutex;
+        unordered_map<Key, TokenMatch, KeyHash> entries;
+        deque<string> keys;   // owns the text; deque never moves elements
+    };
+    vector<Shard> shards;
     
 public:
-    RuleEngine() {
-        initializeRules();
+    TokenCache() : shards(kShards) {}
+    
+    template <typename Compute>
+    TokenMatch get(string_view token, Compute compute) {
+        Key key{token, hash<string_view>()(token)};
+        Shard& shard = shards[key.hash % kShards];
+        {
+            shared_lock<shared_mutex> lock(shard.mutex);
+            auto it = shard.entries.find(key);
+            if (it != shard.entries.end()) return it->second;
+        }
+        
+        TokenMatch match;
+        compute(token, match);
+        unique_lock<shared_mutex> lock(shard.mutex);
+        if (shard.entries.count(key)) return match;
+        if (shard.entries.size() >= kMaxPerShard) {
+            shard.entries.clear();
+            shard.keys.clear();
+        }
+        shard.keys.emplace_back(token);
+        key.text = shard.keys.back();
+        shard.entries.emplace(key, match);
+        return match;
     }
     
-    void analyze(LogEntry& log) {
-        auto start = chrono::high_resolution_clock::now();
+    size_t size() {
+        size_t total = 0;
+        for (auto& shard : shards) {
+            shared_lock<shared_mutex> lock(shard.mutex);
+            total += shard.entries.size();
+        }
+        return total;
+    }
+};
+
+// The original label x rule substring tests for a single keyword, shared
+// by every matcher policy.
+inline void matchRules(const map<string, set<string>>& label_rules, string_view kw, 
+                       TokenMatch& match) {
+    size_t l = 0;
+    for (const auto& entry : label_rules) {
+        for (const auto& rule : entry.second) {
+            bool contains = kw.find(rule) != string_view::npos;
+            if (contains || string_view(rule).find(kw) != string_view::npos) {
+                match.scores[l]++;
+            }
+            if (contains) match.hit_labels |= (uint16_t)(1u << l);
+        }
+        l++;
+    }
+    
+    if (kw.find("config") != string_view::npos) match.category = 1;
+    else if (kw.find("perform") != string_view::npos) match.category = 2;
+    else if (kw.find("connect") != string_view::npos) match.category = 3;
+}
+
+// ---- Tokenizer policies: content -> sorted, unique, top-10 keywords ----
+
+// Builds each word as its own arena string while scanning
+struct ScalarTokenizer {
+    static constexpr const char* kName = "scalar";
+    
+    static KeywordList tokenize(const string& content, RowArena& arena) {
+        KeywordList keywords(arena.resource());
+        ArenaString word(arena.resource());
         
-        // Extract keywords
-        log.keywords = extractKeywords(log.content);
+        // Split on whitespace, lowercase and drop punctuation in one scan
+        auto flush = [&]() {
+            // Keep words longer than 2 characters
+            if (word.length() > 2) {
+                keywords.push_back(word);
+            }
+            word.clear();
+        };
+        scanWords(content, [&](char c) { word.push_back(c); }, flush);
+        flush();
         
-        // Classify
-        log.predicted_label = classify(log.keywords, log.level, log.content);
+        // Remove duplicates
+        sort(keywords.begin(), keywords.end());
+        keywords.erase(unique(keywords.begin(), keywords.end()), keywords.end());
         
-        // Calculate confidence
-        log.confidence = calculateConfidence(log.keywords, log.predicted_label);
+        // Limit to top 10
+        if (keywords.size() > 10) {
+            keywords.resize(10);
+        }
         
-        // Determine severity
-        log.severity_level = determineSeverity(log.level);
+        return keywords;
+    }
+};
+
+// Lowercases the whole row into one buffer and sorts views into it, so
+// only the ten surviving keywords are ever copied into strings
+struct SpanTokenizer {
+    static constexpr const char* kName = "span";
+    
+    static KeywordList tokenize(const string& content, RowArena& arena) {
+        ArenaString text(arena.resource());
+        text.reserve(content.size());
+        pmr::vector<pair<uint32_t, uint32_t>> spans(arena.resource());   // offset, length
         
-        // Other fields
-        log.affected_component = log.component;
-        log.issue_category = categorize(log.keywords);
+        size_t word_start = 0;
+        auto flush = [&]() {
+            if (text.size() - word_start > 2) {
+                spans.emplace_back((uint32_t)word_start, (uint32_t)(text.size() - word_start));
+            }
+            word_start = text.size();
+        };
+        scanWords(content, [&](char c) { text.push_back(c); }, flush);
+        flush();
         
-        auto end = chrono::high_resolution_clock::now();
-        log.stage1_time_ms = chrono::duration<double, milli>(end - start).count();
+        // Views are only taken once `text` has stopped growing
+        pmr::vector<string_view> words(arena.resource());
+        words.reserve(spans.size());
+        for (const auto& [offset, length] : spans) {
+            words.emplace_back(text.data() + offset, length);
+        }
+        sort(words.begin(), words.end());
+        words.erase(unique(words.begin(), words.end()), words.end());
+        if (words.size() > 10) words.resize(10);
+        
+        KeywordList keywords(arena.resource());
+        keywords.reserve(words.size());
+        for (string_view w : words) keywords.emplace_back(w);
+        return keywords;
+    }
+};
+
+// ---- Matcher policies: keyword -> TokenMatch ----
+
+// Runs the substring tests for every keyword of every row
+class ScanMatcher {
+private:
+    const map<string, set<string>>& label_rules;
+    
+public:
+    static constexpr const char* kName = "scan";
+    
+    explicit ScanMatcher(const map<string, set<string>>& rules) : label_rules(rules) {}
+    
+    TokenMatch match(string_view token) {
+        TokenMatch match;
+        matchRules(label_rules, token, match);
+        return match;
+    }
+    
+    size_t cachedTokens() { return 0; }
+};
+
+// Resolves keywords through the token cache; the substring tests only
+// run the first time a keyword is seen
+class CachedMatcher {
+private:
+    const map<string, set<string>>& label_rules;
+    TokenCache cache;
+    
+public:
+    static constexpr const char* kName = "cache";
+    
+    explicit CachedMatcher(const map<string, set<string>>& rules) : label_rules(rules) {}
+    
+    TokenMatch match(string_view token) {
+        return cache.get(token, [this](string_view t, TokenMatch& match) {
+            matchRules(label_rules, t, match);
+        });
+    }
+    
+    size_t cachedTokens() { return cache.size(); }
+};
+
+// ---- Scorer policies: per-keyword matches -> label + confidence ----
+
+// Confidence from the keywords of the winning label that contain a rule
+inline ClassifyResult finishClassify(const vector<string>& label_names, int best_id, 
+                                     int best_hits, bool has_problem) {
+    ClassifyResult result;
+    result.label = label_names[best_id];
+    result.label_id = best_id;
+    if (best_id == 0) {
+        result.confidence = has_problem ? "low" : "high";
+    } else if (best_hits >= 3) {
+        result.confidence = "high";
+    } else if (best_hits >= 1) {
+        result.confidence = "medium";
+    } else {
+        result.confidence = "low";
+    }
+    return result;
+}
+
+// Row scores are the sums of the per-keyword scores (bidirectional
+// substring matches); confidence counts keywords containing a rule.
+struct CountScorer {
+    static constexpr const char* kName = "count";
+    
+    static ClassifyResult score(const pmr::vector<TokenMatch>& matches, const string& level,
+                                const vector<string>& label_names) {
+        int best_id = 0;
+        int max_score = 0;
+        int best_hits = 0;
+        bool has_problem = false;
+        
+        for (size_t l = 0; l + 1 < label_names.size(); l++) {
+            int score = 0;
+            int hits = 0;   // keywords containing at least one rule
+            for (const auto& match : matches) {
+                score += match.scores[l];
+                if (match.hit_labels & (1u << l)) hits++;
+            }
+            
+            if (hits > 0) has_problem = true;
+            if (score > max_score) {
+                max_score = score;
+                best_id = (int)l + 1;
+                best_hits = hits;
+            }
+        }
+        
+        // Even with low score, if INFO level, likely normal
+        if (max_score <= 1 && level == "INFO") {
+            best_id = 0;
+        }
+        return finishClassify(label_names, best_id, best_hits, has_problem);
+    }
+};
+
+// Ranks labels like CountScorer, but a keyword that contains a rule of
+// the label earns an extra point, so "connectionrefused" outweighs a
+// stray fragment like "con". The INFO cutoff still applies to the plain
+// score of the winner. Not result-compatible with the reference classifier.
+struct WeightedScorer {
+    static constexpr const char* kName = "weighted";
+    
+    static ClassifyResult score(const pmr::vector<TokenMatch>& matches, const string& level,
+                                const vector<string>& label_names) {
+        int best_id = 0;
+        int max_weight = 0;
+        int best_score = 0;
+        int best_hits = 0;
+        bool has_problem = false;
+        
+        for (size_t l = 0; l + 1 < label_names.size(); l++) {
+            int score = 0;
+            int hits = 0;
+            for (const auto& match : matches) {
+                score += match.scores[l];
+                if (match.hit_labels & (1u << l)) hits++;
+            }
+            
+            if (hits > 0) has_problem = true;
+            if (score + hits > max_weight) {
+                max_weight = score + hits;
+                best_id = (int)l + 1;
+                best_score = score;
+                best_hits = hits;
+            }
+        }
+        
+        if (best_score <= 1 && level == "INFO") {
+            best_id = 0;
+        }
+        return finishClassify(label_names, best_id, best_hits, has_problem);
+    }
+};
+
+// Rules and label names, shared by every policy
+// combination. The pipeline holds a RuleEngine&; the per-row work is in
+// BasicRuleEngine, where the policies are inlined.
+class RuleEngine {
+private:
+    map<string, set<string>> label_rules;
+    vector<string> label_names;     // "-" followed by label_rules order
+    
+public:
+    RuleEngine() {
+        initializeRules();
+    }
+    virtual ~RuleEngine() = default;
+    RuleEngine(const RuleEngine&) = delete;
+    RuleEngine& operator=(const RuleEngine&) = delete;
+    
+    // Per-row temporaries are carved from `arena`; the caller resets it
+    // once the row (or batch) is done.
+    virtual void analyze(LogEntry& log, RowArena& arena) = 0;
+    
+    // Stage 1 building blocks, also driven directly by bench_stage1
+    virtual KeywordList extractKeywords(const string& content, RowArena& arena) = 0;
+    virtual ClassifyResult classify(const KeywordList& keywords, const string& level) = 0;
+    virtual pmr::vector<TokenMatch> matchKeywords(const KeywordList& keywords,
+                                                  pmr::memory_resource* resource) = 0;
+    virtual size_t cachedTokens() = 0;
+    
+    const map<string, set<string>>& rules() const { return label_rules; }
+    const vector<string>& labelNames() const { return label_names; }
+    
+    // True when classify() would certainly return "-" / "high": an INFO
+    // row where no keyword contains a rule and no label sums to more
+    // than 1. Takes the matchKeywords() output, which analyze() already
+    // holds, so the early exit only skips the scorer.
+    bool isQuietInfo(const pmr::vector<TokenMatch>& matches, const string& level) const {
+        if (level != "INFO") return false;
+        
+        int scores[TokenMatch::kMaxLabels] = {};
+        for (const auto& match : matches) {
+            if (match.hit_labels) return false;
+            for (size_t l = 0; l + 1 < label_names.size(); l++) {
+                scores[l] += match.scores[l];
+                if (scores[l] > 1) return false;
+            }
+        }
+        return true;
+    }
+    
+    Severity determineSeverity(const string& level) const {
+        if (level == "CRITICAL" || level == "FATAL") return SEV_CRITICAL;
+        if (level == "ERROR") return SEV_ERROR;
+        if (level == "WARN" || level == "WARNING") return SEV_WARNING;
+        return SEV_INFO;
+    }
+    
+protected:
+    static string categorize(const pmr::vector<TokenMatch>& matches) {
+        for (const auto& match : matches) {
+            if (match.category) return kCategoryNames[match.category];
+        }
+        return kCategoryNames[0];
     }
     
 private:
@@ -137,143 +732,130 @@ private:
             "error", "exception", "failed", "crash", "abort",
             "core", "fault", "fatal", "panic", "signal"
         };
-    }
-    
-    vector<string> extractKeywords(const string& content) {
-        vector<string> keywords;
-        string lower_content = toLowerCase(content);
-        
-        // Simple tokenization
-        istringstream iss(lower_content);
-        string word;
-        while (iss >> word) {
-            // Remove punctuation
-            word.erase(
-                remove_if(word.begin(), word.end(), 
-                         [](char c) { return !isalnum(c); }), 
-                word.end()
-            );
-            
-            // Keep words longer than 2 characters
-            if (word.length() > 2) {
-                keywords.push_back(word);
-            }
-        }
-        
-        // Remove duplicates
-        sort(keywords.begin(), keywords.end());
-        keywords.erase(unique(keywords.begin(), keywords.end()), keywords.end());
         
-        // Limit to top 10
-        if (keywords.size() > 10) {
-            keywords.resize(10);
+        label_names.push_back("-");
+        for (const auto& entry : label_rules) {
+            label_names.push_back(entry.first);
         }
-        
-        return keywords;
     }
+};
+
+template <typename Tokenizer, typename Matcher, typename Scorer>
+class BasicRuleEngine final : public RuleEngine {
+private:
+    Matcher matcher;
     
-    string classify(const vector<string>& keywords, const string& level, 
-                   const string& content) {
-        map<string, int> scores;
-        
-        // Calculate matching scores for each label
-        for (const auto& [label, rules] : label_rules) {
-            int score = 0;
-            for (const auto& kw : keywords) {
-                for (const auto& rule : rules) {
-                    if (kw.find(rule) != string::npos || 
-                        rule.find(kw) != string::npos) {
-                        score++;
-                    }
-                }
-            }
-            scores[label] = score;
+public:
+    BasicRuleEngine() : matcher(rules()) {}
+    
+    // One matcher lookup per keyword feeds both classify and categorize
+    pmr::vector<TokenMatch> matchKeywords(const KeywordList& keywords,
+                                          pmr::memory_resource* resource) override {
+        pmr::vector<TokenMatch> matches(resource);
+        matches.reserve(keywords.size());
+        for (const auto& kw : keywords) {
+            matches.push_back(matcher.match(string_view(kw.data(), kw.size())));
         }
+        return matches;
+    }
+    
+    void analyze(LogEntry& log, RowArena& arena) override {
+        auto start = chrono::high_resolution_clock::now();
         
-        // Find best match
-        string best_label = "-";
-        int max_score = 0;
-        for (const auto& [label, score] : scores) {
-            if (score > max_score) {
-                max_score = score;
-                best_label = label;
-            }
-        }
+        // Extract keywords
+        KeywordList keywords = Tokenizer::tokenize(log.content, arena);
+        pmr::vector<TokenMatch> matches = matchKeywords(keywords, arena.resource());
         
-        // If no keywords matched and level is INFO, it's normal
-        if (max_score == 0 && level == "INFO") {
-            return "-";
+        // Quiet INFO rows are settled from the keyword matches; everything
+        // else goes through the full classify + confidence pass
+        log.fast_path = isQuietInfo(matches, log.level);
+        if (log.fast_path) {
+            log.predicted_label = "-";
+            log.predicted_label_id = 0;
+            log.confidence = "high";
+        } else {
+            ClassifyResult result = Scorer::score(matches, log.level, labelNames());
+            log.predicted_label = result.label;
+            log.predicted_label_id = (uint8_t)result.label_id;
+            log.confidence = result.confidence;
         }
         
-        // Even with low score, if INFO level, likely normal
-        if (max_score <= 1 && level == "INFO") {
-            return "-";
-        }
+        // Determine severity
+        log.severity_id = determineSeverity(log.level);
+        log.severity_level = kSeverityNames[log.severity_id];
         
-        return best_label;
-    }
-    
-    string calculateConfidence(const vector<string>& keywords, 
-                              const string& label) {
-        if (label == "-") {
-            // Check if there are any problem keywords
-            bool has_problem = false;
-            for (const auto& [lbl, rules] : label_rules) {
-                for (const auto& kw : keywords) {
-                    for (const auto& rule : rules) {
-                        if (kw.find(rule) != string::npos) {
-                            has_problem = true;
-                            break;
-                        }
-                    }
-                    if (has_problem) break;
-                }
-                if (has_problem) break;
-            }
-            return has_problem ? "low" : "high";
-        }
+        // Other fields
+        log.affected_component = log.component;
+        log.issue_category = categorize(matches);
         
-        // For problem categories
-        int match_count = 0;
-        if (label_rules.count(label)) {
-            for (const auto& kw : keywords) {
-                for (const auto& rule : label_rules.at(label)) {
-                    if (kw.find(rule) != string::npos) {
-                        match_count++;
-                        break;
-                    }
-                }
-            }
-        }
+        // Only the surviving keywords outlive the arena
+        log.keywords.assign(keywords.begin(), keywords.end());
         
-        if (match_count >= 3) return "high";
-        if (match_count >= 1) return "medium";
-        return "low";
+        auto end = chrono::high_resolution_clock::now();
+        log.stage1_time_ms = chrono::duration<double, milli>(end - start).count();
     }
     
-    string determineSeverity(const string& level) {
-        if (level == "CRITICAL" || level == "FATAL") return "CRITICAL";
-        if (level == "ERROR") return "ERROR";
-        if (level == "WARN" || level == "WARNING") return "WARNING";
-        return "INFO";
+    KeywordList extractKeywords(const string& content, RowArena& arena) override {
+        return Tokenizer::tokenize(content, arena);
     }
     
-    string categorize(const vector<string>& keywords) {
-        for (const auto& kw : keywords) {
-            if (kw.find("config") != string::npos) return "Configuration";
-            if (kw.find("perform") != string::npos) return "Performance";
-            if (kw.find("connect") != string::npos) return "Connectivity";
-        }
-        return "General";
+    ClassifyResult classify(const KeywordList& keywords, const string& level) override {
+        return Scorer::score(matchKeywords(keywords, pmr::get_default_resource()), 
+                             level, labelNames());
     }
     
-    string toLowerCase(string s) {
-        transform(s.begin(), s.end(), s.begin(), ::tolower);
-        return s;
-    }
+    size_t cachedTokens() override { return matcher.cachedTokens(); }
 };
 
-// ============================================================================
+// Every tokenizer x matcher x scorer combination, selectable with --engine
+struct RuleEngineVariant {
+    string name;                       // "<tokenizer>-<matcher>-<scorer>"
+    unique_ptr<RuleEngine> (*make)();
+    bool exact;                        // reproduces the reference classifier
+};
+
+template <typename Tokenizer, typename Matcher, typename Scorer>
+RuleEngineVariant ruleEngineVariant() {
+    return {string(Tokenizer::kName) + "-" + Matcher::kName + "-" + Scorer::kName,
+            []() -> unique_ptr<RuleEngine> {
+                return make_unique<BasicRuleEngine<Tokenizer, Matcher, Scorer>>();
+            },
+            !is_same<Scorer, WeightedScorer>::value};
+}
+
+template <typename Tokenizer, typename Matcher>
+void addScorerVariants(vector<RuleEngineVariant>& variants) {
+    variants.push_back(ruleEngineVariant<Tokenizer, Matcher, CountScorer>());
+    variants.push_back(ruleEngineVariant<Tokenizer, Matcher, WeightedScorer>());
+}
+
+template <typename Tokenizer>
+void addMatcherVariants(vector<RuleEngineVariant>& variants) {
+    addScorerVariants<Tokenizer, CachedMatcher>(variants);
+    addScorerVariants<Tokenizer, ScanMatcher>(variants);
+}
+
+const vector<RuleEngineVariant>& ruleEngineVariants() {
+    static const vector<RuleEngineVariant> variants = []() {
+        vector<RuleEngineVariant> v;
+        addMatcherVariants<SpanTokenizer>(v);
+        addMatcherVariants<ScalarTokenizer>(v);
+        return v;
+    }();
+    return variants;
+}
+
+static const char* const kDefaultRuleEngine = "span-cache-count";
+
+// nullptr if `name` is not in ruleEngineVariants()
+unique_ptr<RuleEngine> makeRuleEngine(const string& name) {
+    for (const auto& variant : ruleEngineVariants()) {
+        if (variant.name == name) return variant.make();
+    }
+    return nullptr;
+}
+
+// ============================================================================
 // Report Generator (Stage 2)
 // ============================================================================
 
@@ -294,342 +876,5142 @@ public:
 // CSV Parser
 // ============================================================================
 
-vector<LogEntry> loadCSV(const string& filename) {
-    vector<LogEntry> logs;
-    ifstream file(filename);
+// Fields a row can carry. Where each one sits in the file is decided by
+// the header row (see ExtractionPlan), so BGL, Thunderbird, Spirit and
+// HDFS exports all load through the same reader.
+enum Column {
+    COL_LINE_ID,
+    COL_LABEL,
+    COL_TIMESTAMP,
+    COL_DATE,
+    COL_NODE,
+    COL_TIME,
+    COL_COMPONENT,
+    COL_LEVEL,
+    COL_CONTENT,
+    COL_EVENT_ID,
+    COL_EVENT_TEMPLATE,
+    COL_COUNT
+};
+
+using ColumnMask = uint32_t;
+
+constexpr ColumnMask columnBit(Column c) { return 1u << c; }
+
+static const ColumnMask ALL_COLUMNS = (1u << COL_COUNT) - 1;
+
+// Destination of each string column in LogEntry (nullptr = parsed as int)
+static string LogEntry::* const kColumnTargets[COL_COUNT] = {
+    nullptr,                        // LineId
+    &LogEntry::label,
+    &LogEntry::timestamp,
+    &LogEntry::date,
+    &LogEntry::node,
+    &LogEntry::time,
+    &LogEntry::component,
+    &LogEntry::level,
+    &LogEntry::content,
+    &LogEntry::event_id,
+    &LogEntry::event_template,
+};
+
+// LogHub header names for each field. Unlisted columns (BGL NodeRepeat
+// and Type, Thunderbird User/Month/Day/PID, ...) are skipped.
+static const pair<const char*, Column> kHeaderNames[] = {
+    {"LineId", COL_LINE_ID},
+    {"Label", COL_LABEL},
+    {"Timestamp", COL_TIMESTAMP},
+    {"Date", COL_DATE},
+    {"Node", COL_NODE},
+    {"Location", COL_NODE},         // Thunderbird, Spirit
+    {"Host", COL_NODE},
+    {"Time", COL_TIME},
+    {"Component", COL_COMPONENT},
+    {"Level", COL_LEVEL},
+    {"Content", COL_CONTENT},
+    {"EventId", COL_EVENT_ID},
+    {"EventTemplate", COL_EVENT_TEMPLATE},
+};
+
+// BGL locations encode the machine topology, e.g. R36-M1-N9-C:J17-U01 is
+// rack 36, midplane 1, node card 9. decodeNode() packs that into 16 bits:
+//   bit 15     location decoded (rack + midplane)
+//   bit 14     node card present
+//   bits 5-11  rack (0-99)
+//   bit 4      midplane
+//   bits 0-3   node card (hex digit)
+static const uint16_t TOPO_VALID = 0x8000;
+static const uint16_t TOPO_HAS_NODE_CARD = 0x4000;
+static const int TOPO_RACKS = 100;
+static const int TOPO_MIDPLANES = TOPO_RACKS * 2;
+static const int TOPO_NODE_CARDS = TOPO_MIDPLANES * 16;
+
+inline int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+uint16_t decodeNode(const char* p, size_t n) {
+    // Rnn-Mm[-Nh...]
+    if (n < 6 || p[0] != 'R' || p[3] != '-' || p[4] != 'M') return 0;
+    if (!isDigitChar(p[1]) || !isDigitChar(p[2])) return 0;
+    if (p[5] != '0' && p[5] != '1') return 0;
+    
+    uint16_t rack = (p[1] - '0') * 10 + (p[2] - '0');
+    uint16_t topo = TOPO_VALID | (rack << 5) | ((p[5] - '0') << 4);
+    
+    if (n >= 9 && p[6] == '-' && p[7] == 'N') {
+        int card = hexDigit(p[8]);
+        if (card >= 0 && (n == 9 || p[9] == '-')) {
+            topo |= TOPO_HAS_NODE_CARD | card;
+        }
+    }
+    return topo;
+}
+
+inline int topoRack(uint16_t topo) { return (topo >> 5) & 0x7f; }
+inline int topoMidplane(uint16_t topo) { return (topo >> 4) & 0xff; }    // rack * 2 + midplane
+inline int topoNodeCard(uint16_t topo) { return topo & 0xfff; }          // midplane index * 16 + card
+
+// Parses [first, last) as exactly one number without throwing;
+// errc::invalid_argument if anything else is left over. Shared by the
+// LineId column and numeric command-line and query arguments.
+template <typename T>
+errc parseNumber(const char* first, const char* last, T& value) {
+    auto [ptr, ec] = from_chars(first, last, value);
+    if (ec == errc() && ptr != last) return errc::invalid_argument;
+    return ec;
+}
+
+template <typename T>
+bool parseNumber(const string& text, T& value) {
+    return parseNumber(text.data(), text.data() + text.size(), value) == errc();
+}
+
+// Timestamp column: unix seconds, -1 if absent or malformed
+int64_t parseUnixTime(const char* p, const char* end) {
+    if (p == end) return -1;
+    int64_t ts = 0;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') return -1;
+        ts = ts * 10 + (*p - '0');
+    }
+    return ts;
+}
+
+// Returns the end of the field starting at `p` and stores its unquoted
+// value in `value`. Plain fields are a memchr away; quoted fields (LogHub
+// quotes any Content containing a comma) are unescaped into `scratch`.
+// Returns nullptr if a quoted field is never closed.
+inline const char* scanField(const char* p, const char* end, string& scratch,
+                             const char*& value, size_t& length) {
+    if (p == end || *p != '"') {
+        const char* comma = static_cast<const char*>(memchr(p, ',', end - p));
+        const char* field_end = comma ? comma : end;
+        value = p;
+        length = field_end - p;
+        return field_end;
+    }
     
-    if (!file.is_open()) {
-        cerr << "Error: Cannot open file " << filename << endl;
-        return logs;
+    scratch.clear();
+    bool closed = false;
+    for (p++; p < end; p++) {
+        if (*p == '"') {
+            if (p + 1 < end && p[1] == '"') {
+                scratch.push_back('"');
+                p++;
+            } else {
+                p++;
+                closed = true;
+                break;
+            }
+        } else {
+            scratch.push_back(*p);
+        }
     }
+    if (!closed) return nullptr;
     
-    string line;
-    // Skip header
-    getline(file, line);
-    
-    int line_count = 0;
-    while (getline(file, line)) {
-        if (line.empty()) continue;
-        
-        line_count++;
-        LogEntry log;
-        stringstream ss(line);
-        string field;
-        
-        try {
-            // Parse CSV: LineId,Label,Timestamp,Date,Node,Time,NodeRepeat,Type,Component,Level,Content,EventId,EventTemplate
-            getline(ss, field, ','); 
-            log.line_id = stoi(field);
-            
-            getline(ss, field, ','); 
-            log.label = field;
-            
-            getline(ss, field, ','); 
-            log.timestamp = field;
-            
-            getline(ss, field, ','); 
-            log.date = field;
+    // Anything between the closing quote and the delimiter is dropped
+    const char* comma = static_cast<const char*>(memchr(p, ',', end - p));
+    value = scratch.data();
+    length = scratch.size();
+    return comma ? comma : end;
+}
+
+// Per-run field extraction plan compiled from the header: one step per
+// file column up to the last one needed, so the row loop is a flat walk
+// with no name lookups and stops as soon as the plan is exhausted.
+struct ExtractionPlan {
+    vector<int8_t> steps;          // file column -> Column, or -1 to skip
+    ColumnMask present = 0;        // fields found in the header
+    size_t file_columns = 0;
+    
+    void compile(const vector<string>& header, ColumnMask projection) {
+        steps.assign(header.size(), -1);
+        present = 0;
+        file_columns = header.size();
+        size_t last = 0;
+        for (size_t i = 0; i < header.size(); i++) {
+            for (const auto& [name, column] : kHeaderNames) {
+                if (header[i] != name || (present & columnBit(column))) continue;
+                present |= columnBit(column);
+                if (projection & columnBit(column)) {
+                    steps[i] = (int8_t)column;
+                    last = i + 1;
+                }
+                break;
+            }
+        }
+        steps.resize(last);
+    }
+    
+    int mappedColumns() const {
+        int n = 0;
+        for (int8_t step : steps) n += step >= 0;
+        return n;
+    }
+};
+
+// Rejected rows, written verbatim after their reason and input line number:
+//   Reason,Line,Row
+// Buffered in memory and written in large chunks, so a file full of bad
+// rows costs one fwrite per megabyte rather than one per row.
+class QuarantineWriter {
+private:
+    static constexpr size_t kFlushBytes = 1 << 20;
+    
+    FILE* file = nullptr;
+    string buffer;
+    long rows = 0;
+    
+public:
+    explicit QuarantineWriter(const string& path) {
+        file = fopen(path.c_str(), "w");
+        if (file) buffer = "Reason,Line,Row\n";
+    }
+    
+    ~QuarantineWriter() {
+        flush();
+        if (file) fclose(file);
+    }
+    
+    QuarantineWriter(const QuarantineWriter&) = delete;
+    QuarantineWriter& operator=(const QuarantineWriter&) = delete;
+    
+    bool isOpen() const { return file != nullptr; }
+    long rowCount() const { return rows; }
+    
+    void write(ParseError reason, int line_number, const string& line) {
+        if (!file) return;
+        buffer += kParseErrorNames[reason];
+        buffer += ',';
+        buffer += to_string(line_number);
+        buffer += ',';
+        buffer += line;
+        buffer += '\n';
+        rows++;
+        if (buffer.size() >= kFlushBytes) flush();
+    }
+    
+    void flush() {
+        if (!file || buffer.empty()) return;
+        fwrite(buffer.data(), 1, buffer.size(), file);
+        fflush(file);
+        buffer.clear();
+    }
+};
+
+// Streaming reader so large inputs can be consumed in bounded segments.
+// Only columns in `projection` are materialized; the rest are skipped by
+// scanning for the next delimiter, and scanning stops after the last
+// projected column.
+class CSVReader {
+private:
+    unique_ptr<istream> file;
+    string filename;
+    ColumnMask projection;
+    ExtractionPlan plan;
+    string scratch;            // unescaped quoted field
+    ParseErrorCounts errors;
+    QuarantineWriter* quarantine = nullptr;
+    int line_count = 0;        // data rows seen
+    int file_line = 1;         // physical line of the current row (header = 1)
+    uint64_t bytes_read = 0;   // input consumed, including newlines
+    bool is_open = false;
+    bool at_eof = false;
+    
+    void readHeader() {
+        string header;
+        getline(*file, header);
+        bytes_read = header.size() + 1;
+        if (!header.empty() && header.back() == '\r') header.pop_back();
+        
+        vector<string> names;
+        const char* p = header.data();
+        const char* end = p + header.size();
+        while (true) {
+            const char* value;
+            size_t length;
+            const char* field_end = scanField(p, end, scratch, value, length);
+            if (!field_end) break;
+            names.emplace_back(value, length);
+            if (field_end == end) break;
+            p = field_end + 1;
+        }
+        plan.compile(names, projection);
+        
+        ColumnMask missing = projection & ~plan.present & ~columnBit(COL_LINE_ID);
+        for (const auto& [name, column] : kHeaderNames) {
+            if (missing & columnBit(column)) {
+                cerr << "Warning: " << filename << " has no " << name << " column" << endl;
+                missing &= ~columnBit(column);
+            }
+        }
+    }
+    
+public:
+    explicit CSVReader(const string& path, ColumnMask columns = ALL_COLUMNS)
+        : file(new ifstream(path)), filename(path), projection(columns | columnBit(COL_LINE_ID)) {
+        is_open = static_cast<ifstream&>(*file).is_open();
+        
+        if (!is_open) {
+            cerr << "Error: Cannot open file " << filename << endl;
+            return;
+        }
+        readHeader();
+    }
+    
+    // Reads CSV text (header row first) from memory, e.g. a batch received
+    // by the daemon
+    CSVReader(const string& csv, const string& name, ColumnMask columns)
+        : file(new istringstream(csv)), filename(name), 
+          projection(columns | columnBit(COL_LINE_ID)), is_open(true) {
+        readHeader();
+    }
+    
+    bool isOpen() const { return is_open; }
+    bool exhausted() const { return at_eof; }
+    uint64_t offset() const { return bytes_read; }
+    const ExtractionPlan& extractionPlan() const { return plan; }
+    const ParseErrorCounts& parseErrors() const { return errors; }
+    
+    // Rejected rows are counted either way; with a writer they are also kept
+    void setQuarantine(QuarantineWriter* writer) { quarantine = writer; }
+    
+    // Parses the next well-formed row into `log`. Returns false at EOF.
+    bool next(LogEntry& log, size_t* line_bytes = nullptr) {
+        string line;
+        while (getline(*file, line)) {
+            bytes_read += line.size() + 1;
+            file_line++;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
             
-            getline(ss, field, ','); 
-            log.node = field;
+            line_count++;
+            if (parseLine(line, log)) {
+                if (line_bytes) *line_bytes = line.size();
+                return true;
+            }
+        }
+        at_eof = true;
+        return false;
+    }
+    
+private:
+    bool reject(ParseError reason, const string& line) {
+        errors.counts[reason]++;
+        if (quarantine) quarantine->write(reason, file_line, line);
+        return false;
+    }
+    
+    // Never throws: malformed rows are rejected with a reason code
+    bool parseLine(const string& line, LogEntry& log) {
+        const char* p = line.data();
+        const char* end = p + line.size();
+        
+        // Inputs without a LineId column are numbered by data row
+        if (!(plan.present & columnBit(COL_LINE_ID))) log.line_id = line_count;
+        
+        bool more = true;
+        for (int8_t column : plan.steps) {
+            if (!more) return reject(PARSE_MISSING_COLUMNS, line);
             
-            getline(ss, field, ','); 
-            log.time = field;
+            const char* value;
+            size_t length;
+            const char* field_end = scanField(p, end, scratch, value, length);
+            if (!field_end) return reject(PARSE_UNTERMINATED_QUOTE, line);
             
-            getline(ss, field, ','); // NodeRepeat (skip)
-            getline(ss, field, ','); // Type (skip)
+            if (column == COL_LINE_ID) {
+                errc ec = parseNumber(value, value + length, log.line_id);
+                if (ec == errc::result_out_of_range) return reject(PARSE_LINE_ID_RANGE, line);
+                if (ec != errc()) return reject(PARSE_BAD_LINE_ID, line);
+            } else if (column >= 0) {
+                (log.*kColumnTargets[column]).assign(value, length);
+                if (column == COL_NODE) {
+                    log.topology = decodeNode(value, length);
+                } else if (column == COL_TIMESTAMP) {
+                    log.unix_time = parseUnixTime(value, value + length);
+                }
+            }
             
-            getline(ss, field, ','); 
-            log.component = field;
+            more = field_end != end;
+            p = more ? field_end + 1 : end;
+        }
+        
+        return true;
+    }
+};
+
+vector<LogEntry> loadCSV(const string& filename) {
+    vector<LogEntry> logs;
+    CSVReader reader(filename);
+    
+    LogEntry log;
+    while (reader.next(log)) {
+        logs.push_back(log);
+    }
+    
+    cout << "Loaded " << logs.size() << " logs from " << filename << endl;
+    return logs;
+}
+
+// ============================================================================
+// Streaming Sketches
+// ============================================================================
+
+inline uint64_t mix64(uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+inline uint64_t hashKey(const string& key) {
+    return mix64(hash<string>()(key));
+}
+
+// Count-Min sketch. With width w and depth d, an estimate overcounts by at
+// most (e / w) * N with probability 1 - e^-d, where N is the total count.
+class CountMinSketch {
+private:
+    size_t width_mask;
+    size_t depth;
+    vector<uint32_t> table;
+    uint64_t total = 0;
+    
+public:
+    explicit CountMinSketch(size_t width = 2048, size_t rows = 4)
+        : width_mask(width - 1), depth(rows), table(width * rows, 0) {}
+    
+    size_t width() const { return width_mask + 1; }
+    size_t rows() const { return depth; }
+    uint64_t totalCount() const { return total; }
+    size_t memoryBytes() const { return table.size() * sizeof(uint32_t); }
+    double epsilon() const { return exp(1.0) / width(); }
+    double delta() const { return exp(-(double)depth); }
+    
+    void add(uint64_t h, uint32_t count = 1) {
+        // Double hashing: row i probes h1 + i * h2
+        uint64_t h1 = h, h2 = mix64(h) | 1;
+        for (size_t i = 0; i < depth; i++) {
+            table[i * width() + ((h1 + i * h2) & width_mask)] += count;
+        }
+        total += count;
+    }
+    
+    uint32_t estimate(uint64_t h) const {
+        uint64_t h1 = h, h2 = mix64(h) | 1;
+        uint32_t est = UINT32_MAX;
+        for (size_t i = 0; i < depth; i++) {
+            est = min(est, table[i * width() + ((h1 + i * h2) & width_mask)]);
+        }
+        return est;
+    }
+    
+    void merge(const CountMinSketch& other) {
+        for (size_t i = 0; i < table.size(); i++) table[i] += other.table[i];
+        total += other.total;
+    }
+};
+
+// Space-Saving top-K summary with `capacity` counters. Any key whose true
+// frequency exceeds N / capacity is guaranteed to be tracked, and each
+// counter overestimates its key by at most `error`.
+class SpaceSaving {
+public:
+    struct Counter {
+        string key;
+        uint64_t count;
+        uint64_t error;
+    };
+    
+private:
+    struct Slot {
+        Counter counter;
+        size_t heap_pos;
+    };
+    
+    size_t capacity;
+    vector<Slot> slots;
+    vector<size_t> heap;                   // min-heap of slot ids by count
+    unordered_map<string, size_t> index;   // key -> slot id
+    
+    bool less(size_t a, size_t b) const {
+        return slots[heap[a]].counter.count < slots[heap[b]].counter.count;
+    }
+    
+    void swapHeap(size_t a, size_t b) {
+        swap(heap[a], heap[b]);
+        slots[heap[a]].heap_pos = a;
+        slots[heap[b]].heap_pos = b;
+    }
+    
+    void siftUp(size_t pos) {
+        while (pos > 0) {
+            size_t parent = (pos - 1) / 2;
+            if (!less(pos, parent)) break;
+            swapHeap(pos, parent);
+            pos = parent;
+        }
+    }
+    
+    void siftDown(size_t pos) {
+        while (true) {
+            size_t smallest = pos;
+            size_t l = 2 * pos + 1, r = l + 1;
+            if (l < heap.size() && less(l, smallest)) smallest = l;
+            if (r < heap.size() && less(r, smallest)) smallest = r;
+            if (smallest == pos) break;
+            swapHeap(pos, smallest);
+            pos = smallest;
+        }
+    }
+    
+public:
+    explicit SpaceSaving(size_t counters = 64) : capacity(counters) {
+        slots.reserve(capacity);
+        heap.reserve(capacity);
+    }
+    
+    uint64_t minCount() const {
+        return slots.size() < capacity ? 0 : slots[heap[0]].counter.count;
+    }
+    
+    // Counters plus index overhead, excluding key heap storage
+    size_t memoryBytes() const {
+        return capacity * (sizeof(Slot) + sizeof(size_t) + 2 * sizeof(void*));
+    }
+    
+    void add(const string& key, uint64_t count = 1, uint64_t error = 0) {
+        if (capacity == 0) return;
+        
+        auto it = index.find(key);
+        if (it != index.end()) {
+            Slot& slot = slots[it->second];
+            slot.counter.count += count;
+            slot.counter.error += error;
+            siftDown(slot.heap_pos);
+            return;
+        }
+        
+        if (slots.size() < capacity) {
+            size_t id = slots.size();
+            slots.push_back({{key, count, error}, heap.size()});
+            heap.push_back(id);
+            index.emplace(key, id);
+            siftUp(heap.size() - 1);
+            return;
+        }
+        
+        // Evict the minimum; the newcomer inherits its count as error
+        size_t id = heap[0];
+        Slot& slot = slots[id];
+        uint64_t floor = slot.counter.count;
+        index.erase(slot.counter.key);
+        slot.counter.key = key;
+        slot.counter.count = floor + count;
+        slot.counter.error = floor + error;
+        index.emplace(key, id);
+        siftDown(0);
+    }
+    
+    // Mergeable summary: keys missing from one side may have occurred up
+    // to that side's minimum count, which is carried as extra error.
+    void merge(const SpaceSaving& other) {
+        uint64_t this_min = minCount();
+        uint64_t other_min = other.minCount();
+        
+        unordered_map<string, Counter> combined;
+        for (const auto& slot : slots) {
+            Counter c = slot.counter;
+            auto it = other.index.find(c.key);
+            if (it != other.index.end()) {
+                const Counter& o = other.slots[it->second].counter;
+                c.count += o.count;
+                c.error += o.error;
+            } else {
+                c.count += other_min;
+                c.error += other_min;
+            }
+            combined.emplace(c.key, c);
+        }
+        for (const auto& slot : other.slots) {
+            if (combined.count(slot.counter.key)) continue;
+            Counter c = slot.counter;
+            c.count += this_min;
+            c.error += this_min;
+            combined.emplace(c.key, c);
+        }
+        
+        vector<Counter> merged;
+        merged.reserve(combined.size());
+        for (auto& [key, c] : combined) merged.push_back(move(c));
+        sort(merged.begin(), merged.end(), [](const Counter& a, const Counter& b) {
+            return a.count != b.count ? a.count > b.count : a.key < b.key;
+        });
+        if (merged.size() > capacity) merged.resize(capacity);
+        
+        slots.clear();
+        heap.clear();
+        index.clear();
+        for (auto& c : merged) {
+            size_t id = slots.size();
+            index.emplace(c.key, id);
+            slots.push_back({move(c), heap.size()});
+            heap.push_back(id);
+            siftUp(heap.size() - 1);
+        }
+    }
+    
+    vector<Counter> top(size_t k) const {
+        vector<Counter> result;
+        for (const auto& slot : slots) result.push_back(slot.counter);
+        sort(result.begin(), result.end(), [](const Counter& a, const Counter& b) {
+            return a.count != b.count ? a.count > b.count : a.key < b.key;
+        });
+        if (result.size() > k) result.resize(k);
+        return result;
+    }
+};
+
+// Heavy-hitter tracker for one dimension (nodes, templates or labels)
+struct HeavyHitterTracker {
+    CountMinSketch cms;
+    SpaceSaving summary;
+    
+    explicit HeavyHitterTracker(size_t k = 10) : summary(4 * k) {}
+    
+    void add(const string& key) {
+        if (key.empty()) return;
+        cms.add(hashKey(key));
+        summary.add(key);
+    }
+    
+    void merge(const HeavyHitterTracker& other) {
+        cms.merge(other.cms);
+        summary.merge(other.summary);
+    }
+    
+    size_t memoryBytes() const {
+        return cms.memoryBytes() + summary.memoryBytes();
+    }
+    
+    struct Estimate {
+        string key;
+        uint64_t count;         // tighter of the Space-Saving and CMS bounds
+        uint64_t lower_bound;   // guaranteed minimum
+    };
+    
+    vector<Estimate> top(size_t k) const {
+        vector<Estimate> result;
+        for (const auto& c : summary.top(SIZE_MAX)) {
+            uint64_t estimate = min<uint64_t>(c.count, cms.estimate(hashKey(c.key)));
+            result.push_back({c.key, estimate, c.count - c.error});
+        }
+        sort(result.begin(), result.end(), [](const Estimate& a, const Estimate& b) {
+            return a.count != b.count ? a.count > b.count : a.key < b.key;
+        });
+        if (result.size() > k) result.resize(k);
+        return result;
+    }
+};
+
+struct HeavyHitters {
+    size_t k;
+    HeavyHitterTracker nodes;
+    HeavyHitterTracker templates;
+    HeavyHitterTracker labels;
+    
+    explicit HeavyHitters(size_t top_k = 10)
+        : k(top_k), nodes(top_k), templates(top_k), labels(top_k) {}
+    
+    bool enabled() const { return k > 0; }
+    
+    void observe(const LogEntry& log) {
+        nodes.add(log.node);
+        templates.add(log.event_id);
+        labels.add(log.predicted_label);
+    }
+    
+    void merge(const HeavyHitters& other) {
+        nodes.merge(other.nodes);
+        templates.merge(other.templates);
+        labels.merge(other.labels);
+    }
+};
+
+// HyperLogLog with 2^precision one-byte registers. Standard error is about
+// 1.04 / sqrt(2^precision), i.e. 1.6% at the default 4 KB.
+class HyperLogLog {
+private:
+    int precision;
+    vector<uint8_t> registers;
+    
+public:
+    explicit HyperLogLog(int p = 12) : precision(p), registers(size_t(1) << p, 0) {}
+    
+    size_t memoryBytes() const { return registers.size(); }
+    
+    void add(uint64_t h) {
+        size_t idx = h >> (64 - precision);
+        uint64_t rest = h << precision;
+        uint8_t rank = rest == 0 ? uint8_t(64 - precision + 1)
+                                 : uint8_t(__builtin_clzll(rest) + 1);
+        if (rank > registers[idx]) registers[idx] = rank;
+    }
+    
+    void merge(const HyperLogLog& other) {
+        for (size_t i = 0; i < registers.size(); i++) {
+            registers[i] = max(registers[i], other.registers[i]);
+        }
+    }
+    
+    double estimate() const {
+        double m = registers.size();
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : registers) {
+            sum += ldexp(1.0, -r);
+            if (r == 0) zeros++;
+        }
+        
+        double alpha = 0.7213 / (1.0 + 1.079 / m);
+        double e = alpha * m * m / sum;
+        
+        // Small-range correction: linear counting
+        if (e <= 2.5 * m && zeros > 0) {
+            e = m * log(m / zeros);
+        }
+        return e;
+    }
+};
+
+struct DistinctCounts {
+    bool enabled;
+    HyperLogLog nodes;
+    HyperLogLog components;
+    HyperLogLog node_templates;
+    HyperLogLog keywords;
+    
+    explicit DistinctCounts(bool on = true) : enabled(on) {}
+    
+    void observe(const LogEntry& log) {
+        uint64_t node_hash = hashKey(log.node);
+        nodes.add(node_hash);
+        components.add(hashKey(log.component));
+        node_templates.add(mix64(node_hash ^ (hashKey(log.event_id) * 0x9e3779b97f4a7c15ULL)));
+        for (const auto& kw : log.keywords) {
+            keywords.add(hashKey(kw));
+        }
+    }
+    
+    void merge(const DistinctCounts& other) {
+        nodes.merge(other.nodes);
+        components.merge(other.components);
+        node_templates.merge(other.node_templates);
+        keywords.merge(other.keywords);
+    }
+};
+
+// ============================================================================
+// Burst Detection
+// ============================================================================
+
+struct BurstAlert {
+    string kind;            // "node" or "template"
+    string key;
+    int64_t window_start;   // unix seconds
+    uint32_t count;
+    double baseline_mean;
+    double baseline_std;
+};
+
+// Online burst detector over problem rows (severity above INFO or a
+// non-normal prediction). Rows are bucketed into fixed time windows per
+// node and per template; each key keeps an exponentially weighted mean
+// and variance of its per-window counts and raises an alert when a
+// closed window exceeds mean + sigma * std by at least `min_count` rows.
+//
+// State lives in a sharded hash table so all threads can feed it from the
+// processing loop. Two windows stay open per key, which absorbs the
+// reordering introduced by dynamic scheduling.
+class BurstDetector {
+public:
+    struct Config {
+        int64_t window_sec = 300;
+        uint32_t min_count = 10;
+        double sigma = 3.0;
+        double alpha = 0.3;      // EWMA weight of the newest window
+    };
+    
+private:
+    struct KeyState {
+        string kind;
+        string key;
+        int64_t window = INT64_MIN;   // most recent open window
+        uint32_t count = 0;           // rows in `window`
+        uint32_t prev_count = 0;      // rows in `window - 1`
+        double mean = 0;
+        double var = 0;
+    };
+    
+    struct alignas(64) Shard {
+        mutex lock;
+        unordered_map<uint64_t, KeyState> keys;
+        vector<BurstAlert> alerts;
+        uint64_t late_rows = 0;
+    };
+    
+    static constexpr size_t kShards = 64;
+    
+    Config config;
+    vector<Shard> shards;
+    
+    // Scores a closed window against the baseline, then folds it in
+    void closeWindow(KeyState& st, int64_t window, uint32_t count, Shard& shard) {
+        double std_dev = sqrt(st.var);
+        if (count >= config.min_count && count > st.mean + config.sigma * std_dev) {
+            shard.alerts.push_back({st.kind, st.key, window * config.window_sec,
+                                    count, st.mean, std_dev});
+        }
+        double diff = count - st.mean;
+        st.mean += config.alpha * diff;
+        st.var = (1 - config.alpha) * (st.var + config.alpha * diff * diff);
+    }
+    
+    // Empty windows decay the baseline without being scored; after ~64
+    // of them the baseline is effectively zero anyway
+    void decay(KeyState& st, int64_t windows) {
+        for (int64_t i = 0; i < min<int64_t>(windows, 64); i++) {
+            double diff = -st.mean;
+            st.mean += config.alpha * diff;
+            st.var = (1 - config.alpha) * (st.var + config.alpha * diff * diff);
+        }
+    }
+    
+    void advance(KeyState& st, int64_t w, Shard& shard) {
+        // Close `window - 1` and, if we jumped further, `window` as well
+        if (st.window != INT64_MIN) {
+            closeWindow(st, st.window - 1, st.prev_count, shard);
+            if (w > st.window + 1) {
+                closeWindow(st, st.window, st.count, shard);
+                if (w > st.window + 2) decay(st, w - st.window - 2);
+                st.count = 0;
+            }
+        }
+        st.prev_count = (st.window != INT64_MIN && w == st.window + 1) ? st.count : 0;
+        st.window = w;
+        st.count = 0;
+    }
+    
+    void observeKey(const char* kind, const string& key, int64_t w) {
+        if (key.empty()) return;
+        
+        uint64_t h = hashKey(key) ^ (kind[0] == 'n' ? 0 : 0x5bd1e995ULL);
+        Shard& shard = shards[h % kShards];
+        lock_guard<mutex> guard(shard.lock);
+        
+        KeyState& st = shard.keys[h];
+        if (st.key.empty()) {
+            st.kind = kind;
+            st.key = key;
+        }
+        
+        if (w > st.window) {
+            advance(st, w, shard);
+            st.count++;
+        } else if (w == st.window) {
+            st.count++;
+        } else if (w == st.window - 1) {
+            st.prev_count++;
+        } else {
+            shard.late_rows++;
+        }
+    }
+    
+public:
+    explicit BurstDetector(const Config& cfg) : config(cfg), shards(kShards) {}
+    
+    const Config& settings() const { return config; }
+    uint64_t lateRows() {
+        uint64_t total = 0;
+        for (auto& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            total += shard.late_rows;
+        }
+        return total;
+    }
+    
+    void observe(const LogEntry& log) {
+        if (!isProblemRow(log)) return;
+        
+        if (log.unix_time < 0) return;
+        
+        int64_t w = log.unix_time / config.window_sec;
+        observeKey("node", log.node, w);
+        observeKey("template", log.event_id, w);
+    }
+    
+    // Closes every open window and returns all alerts in time order
+    vector<BurstAlert> finish() {
+        vector<BurstAlert> all;
+        for (auto& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            for (auto& [h, st] : shard.keys) {
+                if (st.window == INT64_MIN) continue;
+                closeWindow(st, st.window - 1, st.prev_count, shard);
+                closeWindow(st, st.window, st.count, shard);
+                st.window = INT64_MIN;
+            }
+            all.insert(all.end(), shard.alerts.begin(), shard.alerts.end());
+            shard.alerts.clear();
+        }
+        sort(all.begin(), all.end(), [](const BurstAlert& a, const BurstAlert& b) {
+            if (a.window_start != b.window_start) return a.window_start < b.window_start;
+            if (a.kind != b.kind) return a.kind < b.kind;
+            return a.key < b.key;
+        });
+        return all;
+    }
+};
+
+void saveBurstAlerts(const vector<BurstAlert>& alerts, const string& filename) {
+    ofstream out(filename);
+    
+    out << "Kind,Key,WindowStart,Count,BaselineMean,BaselineStd\n";
+    for (const auto& a : alerts) {
+        out << a.kind << ","
+            << a.key << ","
+            << a.window_start << ","
+            << a.count << ","
+            << fixed << setprecision(2) << a.baseline_mean << ","
+            << fixed << setprecision(2) << a.baseline_std << "\n";
+    }
+    
+    cout << "Burst alerts saved to: " << filename << " (" << alerts.size() << " alerts)" << endl;
+}
+
+// ============================================================================
+// Topology Rollups
+// ============================================================================
+
+// Label and severity counts per rack, midplane and node card, kept in
+// dense arrays indexed by the packed topology coordinates.
+class TopologyRollup {
+public:
+    enum Level { RACK, MIDPLANE, NODE_CARD, LEVEL_COUNT };
+    
+private:
+    size_t num_labels;
+    size_t row_width;                        // labels + severities + problems
+    vector<uint32_t> counts[LEVEL_COUNT];
+    uint64_t unlocated = 0;
+    
+    static size_t levelSize(Level level) {
+        switch (level) {
+            case RACK: return TOPO_RACKS;
+            case MIDPLANE: return TOPO_MIDPLANES;
+            default: return TOPO_NODE_CARDS;
+        }
+    }
+    
+    void bump(Level level, size_t index, const LogEntry& log) {
+        uint32_t* row = &counts[level][index * row_width];
+        row[log.predicted_label_id]++;
+        row[num_labels + log.severity_id]++;
+        row[row_width - 1] += isProblemRow(log);
+    }
+    
+public:
+    explicit TopologyRollup(size_t labels = 0)
+        : num_labels(labels), row_width(labels + SEV_COUNT + 1) {
+        if (labels == 0) return;
+        for (int level = 0; level < LEVEL_COUNT; level++) {
+            counts[level].assign(levelSize((Level)level) * row_width, 0);
+        }
+    }
+    
+    bool enabled() const { return num_labels > 0; }
+    uint64_t unlocatedRows() const { return unlocated; }
+    size_t labelCount() const { return num_labels; }
+    
+    void observe(const LogEntry& log) {
+        uint16_t topo = log.topology;
+        if (!(topo & TOPO_VALID)) {
+            unlocated++;
+            return;
+        }
+        bump(RACK, topoRack(topo), log);
+        bump(MIDPLANE, topoMidplane(topo), log);
+        if (topo & TOPO_HAS_NODE_CARD) {
+            bump(NODE_CARD, topoNodeCard(topo), log);
+        }
+    }
+    
+    void merge(const TopologyRollup& other) {
+        for (int level = 0; level < LEVEL_COUNT; level++) {
+            for (size_t i = 0; i < counts[level].size(); i++) {
+                counts[level][i] += other.counts[level][i];
+            }
+        }
+        unlocated += other.unlocated;
+    }
+    
+    size_t entries(Level level) const { return levelSize(level); }
+    
+    // Counts for one location: labels, then severities, then problem rows
+    const uint32_t* row(Level level, size_t index) const {
+        return &counts[level][index * row_width];
+    }
+    
+    uint64_t total(Level level, size_t index) const {
+        const uint32_t* r = row(level, index);
+        uint64_t sum = 0;
+        for (size_t l = 0; l < num_labels; l++) sum += r[l];
+        return sum;
+    }
+    
+    uint64_t problems(Level level, size_t index) const {
+        return row(level, index)[row_width - 1];
+    }
+    
+    static string locationName(Level level, size_t index) {
+        static const char* kHex = "0123456789ABCDEF";
+        ostringstream name;
+        size_t rack = level == RACK ? index : level == MIDPLANE ? index / 2 : index / 32;
+        name << "R" << setw(2) << setfill('0') << rack;
+        if (level != RACK) {
+            size_t midplane = level == MIDPLANE ? index % 2 : (index / 16) % 2;
+            name << "-M" << midplane;
+        }
+        if (level == NODE_CARD) {
+            name << "-N" << kHex[index % 16];
+        }
+        return name.str();
+    }
+};
+
+// ============================================================================
+// Aggregate Cube
+// ============================================================================
+
+// Row counts by time bucket x rack x predicted label x severity. Each
+// occupied (bucket, rack) pair owns a dense labels x severities block, so
+// memory follows the data rather than the full time range.
+class AggregateCube {
+public:
+    static const int UNLOCATED_RACK = TOPO_RACKS;
+    
+private:
+    int64_t bucket_sec;
+    size_t num_labels;
+    size_t cell_width;                       // labels x severities
+    unordered_map<uint64_t, uint32_t> index; // (bucket << 8 | rack) -> offset
+    vector<uint32_t> counts;
+    uint64_t untimed = 0;
+    
+    static uint64_t cellKey(int64_t bucket, int rack) {
+        return ((uint64_t)bucket << 8) | (uint64_t)rack;
+    }
+    
+    uint32_t* block(uint64_t key) {
+        auto it = index.find(key);
+        if (it == index.end()) {
+            it = index.emplace(key, (uint32_t)counts.size()).first;
+            counts.resize(counts.size() + cell_width, 0);
+        }
+        return &counts[it->second];
+    }
+    
+public:
+    AggregateCube(int64_t bucket_seconds = 0, size_t labels = 0)
+        : bucket_sec(bucket_seconds), num_labels(labels), cell_width(labels * SEV_COUNT) {}
+    
+    bool enabled() const { return bucket_sec > 0; }
+    int64_t bucketSeconds() const { return bucket_sec; }
+    uint64_t untimedRows() const { return untimed; }
+    size_t blocks() const { return index.size(); }
+    
+    void observe(const LogEntry& log) {
+        if (log.unix_time < 0) {
+            untimed++;
+            return;
+        }
+        int rack = (log.topology & TOPO_VALID) ? topoRack(log.topology) : UNLOCATED_RACK;
+        uint32_t* cell = block(cellKey(log.unix_time / bucket_sec, rack));
+        cell[log.predicted_label_id * SEV_COUNT + log.severity_id]++;
+    }
+    
+    void merge(const AggregateCube& other) {
+        for (const auto& [key, offset] : other.index) {
+            uint32_t* dst = block(key);
+            const uint32_t* src = &other.counts[offset];
+            for (size_t i = 0; i < cell_width; i++) dst[i] += src[i];
+        }
+        untimed += other.untimed;
+    }
+    
+    // Writes non-zero cells sorted by bucket, rack, label, severity
+    size_t save(const string& filename, const vector<string>& label_names) const {
+        vector<pair<uint64_t, uint32_t>> cells(index.begin(), index.end());
+        sort(cells.begin(), cells.end());
+        
+        ofstream out(filename);
+        out << "BucketStart,BucketSeconds,Rack,Label,Severity,Count\n";
+        
+        size_t written = 0;
+        for (const auto& [key, offset] : cells) {
+            int64_t bucket = (int64_t)(key >> 8);
+            int rack = (int)(key & 0xff);
+            string rack_name = rack == UNLOCATED_RACK 
+                ? "-" : TopologyRollup::locationName(TopologyRollup::RACK, rack);
+            
+            for (size_t label = 0; label < num_labels; label++) {
+                for (int sev = 0; sev < SEV_COUNT; sev++) {
+                    uint32_t n = counts[offset + label * SEV_COUNT + sev];
+                    if (n == 0) continue;
+                    out << bucket * bucket_sec << ","
+                        << bucket_sec << ","
+                        << rack_name << ","
+                        << label_names[label] << ","
+                        << kSeverityNames[sev] << ","
+                        << n << "\n";
+                    written++;
+                }
+            }
+        }
+        return written;
+    }
+};
+
+// ============================================================================
+// Per-Thread Aggregates
+// ============================================================================
+
+// Accumulators updated inside the processing loop. Each OpenMP thread owns
+// one, so updates never contend; they are merged once after the run.
+struct AggregateConfig {
+    size_t top_k = 10;             // heavy hitters per dimension (0 = off)
+    bool distinct_counts = true;   // HyperLogLog sketches
+    size_t topology_labels = 0;    // label count for rollups (0 = off)
+    int64_t cube_bucket_sec = 0;   // aggregate cube time bucket (0 = off)
+    size_t cube_labels = 0;
+};
+
+struct alignas(64) ThreadAggregates {
+    HeavyHitters heavy_hitters;
+    DistinctCounts distinct;
+    TopologyRollup topology;
+    AggregateCube cube;
+    
+    explicit ThreadAggregates(const AggregateConfig& cfg = AggregateConfig())
+        : heavy_hitters(cfg.top_k), distinct(cfg.distinct_counts),
+          topology(cfg.topology_labels), cube(cfg.cube_bucket_sec, cfg.cube_labels) {}
+    
+    void observe(const LogEntry& log) {
+        if (heavy_hitters.enabled()) heavy_hitters.observe(log);
+        if (distinct.enabled) distinct.observe(log);
+        if (topology.enabled()) topology.observe(log);
+        if (cube.enabled()) cube.observe(log);
+    }
+    
+    void merge(const ThreadAggregates& other) {
+        if (heavy_hitters.enabled()) heavy_hitters.merge(other.heavy_hitters);
+        if (distinct.enabled) distinct.merge(other.distinct);
+        if (topology.enabled()) topology.merge(other.topology);
+        if (cube.enabled()) cube.merge(other.cube);
+    }
+    
+    // Copies merged sketch estimates into the summary statistics
+    void fillStats(PerformanceStats& stats) const {
+        stats.has_distinct_counts = distinct.enabled;
+        if (!distinct.enabled) return;
+        stats.distinct_nodes = distinct.nodes.estimate();
+        stats.distinct_components = distinct.components.estimate();
+        stats.distinct_node_templates = distinct.node_templates.estimate();
+        stats.distinct_keywords = distinct.keywords.estimate();
+    }
+};
+
+// ============================================================================
+// Performance Statistics
+// ============================================================================
+
+// Running totals over processed rows, so statistics can be gathered one
+// segment at a time without keeping every LogEntry alive.
+struct StatsAccumulator {
+    long total_logs = 0;
+    double sum_stage1 = 0;
+    double sum_stage2 = 0;
+    long total_keywords = 0;
+    long total_keyword_chars = 0;
+    long correct = 0;
+    long fast_path = 0;
+    long deduplicated = 0;
+    map<string, int> ground_truth_dist;
+    map<string, int> predicted_dist;
+    
+    void add(const LogEntry& log) {
+        total_logs++;
+        sum_stage1 += log.stage1_time_ms;
+        sum_stage2 += log.stage2_time_ms;
+        
+        total_keywords += log.keywords.size();
+        for (const auto& kw : log.keywords) {
+            total_keyword_chars += kw.length();
+        }
+        
+        if (log.predicted_label == log.label) {
+            correct++;
+        }
+        if (log.fast_path) fast_path++;
+        if (log.deduplicated) deduplicated++;
+        
+        ground_truth_dist[log.label]++;
+        predicted_dist[log.predicted_label]++;
+    }
+    
+    void add(const vector<LogEntry>& logs) {
+        for (const auto& log : logs) add(log);
+    }
+};
+
+PerformanceStats calculateStats(const StatsAccumulator& acc, 
+                                double total_time_sec,
+                                int num_threads) {
+    PerformanceStats stats = {};
+    
+    stats.total_logs = acc.total_logs;
+    stats.num_threads = num_threads;
+    stats.total_time_sec = total_time_sec;
+    
+    stats.stage1_time_sec = acc.sum_stage1 / 1000.0;
+    stats.stage2_time_sec = acc.sum_stage2 / 1000.0;
+    if (total_time_sec > 0) {
+        stats.throughput_logs_per_sec = acc.total_logs / total_time_sec;
+    }
+    
+    double total_stage_time = stats.stage1_time_sec + stats.stage2_time_sec;
+    if (total_stage_time > 0) {
+        stats.stage1_percentage = (stats.stage1_time_sec / total_stage_time) * 100.0;
+        stats.stage2_percentage = (stats.stage2_time_sec / total_stage_time) * 100.0;
+    }
+    
+    stats.correct_predictions = acc.correct;
+    stats.fast_path_rows = acc.fast_path;
+    stats.unique_messages = acc.total_logs - acc.deduplicated;
+    stats.dedup_ratio = stats.unique_messages > 0 ? 
+                        (double)acc.total_logs / stats.unique_messages : 0.0;
+    
+    // Ratios over rows stay 0 before the first row (daemon STATS, idle listener)
+    if (acc.total_logs > 0) {
+        stats.avg_time_per_log_ms = (acc.sum_stage1 + acc.sum_stage2) / acc.total_logs;
+        stats.accuracy_percentage = (100.0 * acc.correct) / acc.total_logs;
+        stats.fast_path_percentage = (100.0 * acc.fast_path) / acc.total_logs;
+        stats.avg_keywords_count = (double)acc.total_keywords / acc.total_logs;
+        stats.avg_keywords_chars = (double)acc.total_keyword_chars / acc.total_logs;
+    }
+    
+    return stats;
+}
+
+long peakMemoryMB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    #ifdef __APPLE__
+        return usage.ru_maxrss / (1024 * 1024);  // Mac
+    #else
+        return usage.ru_maxrss / 1024;            // Linux
+    #endif
+}
+
+void printStats(const PerformanceStats& stats) {
+    cout << "\n" << string(80, '=') << endl;
+    cout << "PERFORMANCE ANALYSIS SUMMARY" << endl;
+    cout << string(80, '=') << endl;
+    
+    cout << "\n--- Overall Throughput ---" << endl;
+    cout << "Total logs: " << stats.total_logs << endl;
+    cout << "Threads: " << stats.num_threads << endl;
+    cout << "Total time: " << fixed << setprecision(3) << stats.total_time_sec << " seconds" << endl;
+    cout << "Throughput: " << fixed << setprecision(2) << stats.throughput_logs_per_sec << " logs/sec" << endl;
+    cout << "Avg time per log: " << fixed << setprecision(3) << stats.avg_time_per_log_ms << " ms" << endl;
+    
+    cout << "\n--- Stage Breakdown ---" << endl;
+    cout << "Stage 1: " << fixed << setprecision(3) << stats.stage1_time_sec << "s (" 
+         << fixed << setprecision(1) << stats.stage1_percentage << "%)" << endl;
+    cout << "Stage 2: " << fixed << setprecision(3) << stats.stage2_time_sec << "s (" 
+         << fixed << setprecision(1) << stats.stage2_percentage << "%)" << endl;
+    cout << "INFO fast path: " << stats.fast_path_rows << " rows (" 
+         << fixed << setprecision(1) << stats.fast_path_percentage << "%)" << endl;
+    
+    if (stats.has_dedup) {
+        cout << "\n--- Content Deduplication ---" << endl;
+        cout << "Unique messages: " << stats.unique_messages << "/" << stats.total_logs << endl;
+        cout << "Dedup ratio: " << fixed << setprecision(2) << stats.dedup_ratio << "x" << endl;
+    }
+    
+    if (stats.has_ground_truth) {
+        cout << "\n--- Prediction Accuracy ---" << endl;
+        cout << "Correct: " << stats.correct_predictions << "/" << stats.total_logs << endl;
+        cout << "Accuracy: " << fixed << setprecision(1) << stats.accuracy_percentage << "%" << endl;
+    }
+    
+    if (stats.parse_errors.total() > 0) {
+        cout << "\n--- Parse Errors ---" << endl;
+        for (int r = 0; r < PARSE_ERROR_COUNT; r++) {
+            if (stats.parse_errors.counts[r] == 0) continue;
+            cout << kParseErrorNames[r] << ": " << stats.parse_errors.counts[r] << endl;
+        }
+    }
+    
+    cout << "\n--- Keywords Statistics ---" << endl;
+    cout << "Avg keywords per log: " << fixed << setprecision(1) << stats.avg_keywords_count << endl;
+    cout << "Avg chars per log: " << fixed << setprecision(1) << stats.avg_keywords_chars << endl;
+    
+    if (stats.has_distinct_counts) {
+        cout << "\n--- Distinct Counts (HyperLogLog) ---" << endl;
+        cout << "Nodes: " << fixed << setprecision(0) << stats.distinct_nodes << endl;
+        cout << "Components: " << fixed << setprecision(0) << stats.distinct_components << endl;
+        cout << "Node x template pairs: " << fixed << setprecision(0) << stats.distinct_node_templates << endl;
+        cout << "Keywords: " << fixed << setprecision(0) << stats.distinct_keywords << endl;
+    }
+    
+    cout << "\n--- Memory Usage ---" << endl;
+    cout << "Peak memory: " << stats.peak_memory_mb << " MB" << endl;
+
+    cout << string(80, '=') << endl;
+}
+
+string jsonEscape(const string& s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c < 0x20) continue;
+        out += c;
+    }
+    return out;
+}
+
+void writeHeavyHittersJSON(ostream& out, const string& name,
+                           const HeavyHitterTracker& tracker, size_t k, bool last) {
+    out << "    \"" << name << "\": [";
+    auto top = tracker.top(k);
+    for (size_t i = 0; i < top.size(); i++) {
+        const auto& e = top[i];
+        out << (i ? ",\n" : "\n");
+        out << "      {\"key\": \"" << jsonEscape(e.key) << "\", "
+            << "\"count\": " << e.count << ", "
+            << "\"lower_bound\": " << e.lower_bound << "}";
+    }
+    out << (top.empty() ? "]" : "\n    ]") << (last ? "\n" : ",\n");
+}
+
+void writeStatsJSON(ostream& out, const PerformanceStats& stats, 
+                    const ThreadAggregates& aggregates) {
+    out << "{\n";
+    out << "  \"metadata\": {\n";
+    out << "    \"scenario\": \"scenario_d\",\n";
+    out << "    \"total_logs_processed\": " << stats.total_logs << ",\n";
+    out << "    \"num_threads\": " << stats.num_threads << ",\n";
+    out << "    \"total_time_seconds\": " << fixed << setprecision(6) << stats.total_time_sec << "\n";
+    out << "  },\n";
+    out << "  \"throughput\": {\n";
+    out << "    \"logs_per_second\": " << fixed << setprecision(3) << stats.throughput_logs_per_sec << ",\n";
+    out << "    \"avg_time_per_log_ms\": " << fixed << setprecision(3) << stats.avg_time_per_log_ms << "\n";
+    out << "  },\n";
+    out << "  \"stage_breakdown\": {\n";
+    out << "    \"stage1_time_sec\": " << fixed << setprecision(6) << stats.stage1_time_sec << ",\n";
+    out << "    \"stage2_time_sec\": " << fixed << setprecision(6) << stats.stage2_time_sec << ",\n";
+    out << "    \"stage1_percentage\": " << fixed << setprecision(2) << stats.stage1_percentage << ",\n";
+    out << "    \"stage2_percentage\": " << fixed << setprecision(2) << stats.stage2_percentage << ",\n";
+    out << "    \"fast_path_rows\": " << stats.fast_path_rows << ",\n";
+    out << "    \"fast_path_percentage\": " << fixed << setprecision(2) << stats.fast_path_percentage << "\n";
+    out << "  },\n";
+    if (stats.has_dedup) {
+        out << "  \"deduplication\": {\n";
+        out << "    \"unique_messages\": " << stats.unique_messages << ",\n";
+        out << "    \"dedup_ratio\": " << fixed << setprecision(4) << stats.dedup_ratio << "\n";
+        out << "  },\n";
+    }
+    if (stats.has_ground_truth) {
+        out << "  \"accuracy\": {\n";
+        out << "    \"correct\": " << stats.correct_predictions << ",\n";
+        out << "    \"total\": " << stats.total_logs << ",\n";
+        out << "    \"accuracy_percentage\": " << fixed << setprecision(2) << stats.accuracy_percentage << "\n";
+        out << "  },\n";
+    }
+    out << "  \"parse_errors\": {\n";
+    for (int r = 0; r < PARSE_ERROR_COUNT; r++) {
+        out << "    \"" << kParseErrorNames[r] << "\": " << stats.parse_errors.counts[r] << ",\n";
+    }
+    out << "    \"total\": " << stats.parse_errors.total() << "\n";
+    out << "  },\n";
+    out << "  \"keywords_statistics\": {\n";
+    out << "    \"avg_keywords_count\": " << fixed << setprecision(2) << stats.avg_keywords_count << ",\n";
+    out << "    \"avg_keywords_chars\": " << fixed << setprecision(2) << stats.avg_keywords_chars << "\n";
+    out << "  },\n";
+    if (stats.has_distinct_counts) {
+        out << "  \"distinct_counts\": {\n";
+        out << "    \"nodes\": " << fixed << setprecision(0) << stats.distinct_nodes << ",\n";
+        out << "    \"components\": " << fixed << setprecision(0) << stats.distinct_components << ",\n";
+        out << "    \"node_templates\": " << fixed << setprecision(0) << stats.distinct_node_templates << ",\n";
+        out << "    \"keywords\": " << fixed << setprecision(0) << stats.distinct_keywords << "\n";
+        out << "  },\n";
+    }
+    out << "  \"memory_usage\": {\n";
+    out << "    \"peak_memory_mb\": " << stats.peak_memory_mb << "\n";
+    
+    const HeavyHitters& hh = aggregates.heavy_hitters;
+    if (hh.enabled()) {
+        out << "  },\n";
+        out << "  \"heavy_hitters\": {\n";
+        out << "    \"top_k\": " << hh.k << ",\n";
+        out << "    \"cms_width\": " << hh.nodes.cms.width() << ",\n";
+        out << "    \"cms_depth\": " << hh.nodes.cms.rows() << ",\n";
+        out << "    \"cms_epsilon\": " << fixed << setprecision(6) << hh.nodes.cms.epsilon() << ",\n";
+        out << "    \"cms_delta\": " << fixed << setprecision(6) << hh.nodes.cms.delta() << ",\n";
+        out << "    \"memory_bytes_per_thread\": "
+            << hh.nodes.memoryBytes() + hh.templates.memoryBytes() + hh.labels.memoryBytes() << ",\n";
+        writeHeavyHittersJSON(out, "nodes", hh.nodes, hh.k, false);
+        writeHeavyHittersJSON(out, "templates", hh.templates, hh.k, false);
+        writeHeavyHittersJSON(out, "labels", hh.labels, hh.k, true);
+    }
+    out << "  }\n";
+    out << "}\n";
+}
+
+void saveStatsJSON(const PerformanceStats& stats, const ThreadAggregates& aggregates,
+                   const string& filename) {
+    ofstream out(filename);
+    writeStatsJSON(out, stats, aggregates);
+    
+    cout << "\nPerformance stats saved to: " << filename << endl;
+}
+
+void writeResultHeader(ostream& out) {
+    out << "LineId,GroundTruth,PredictedLabel,Confidence,Severity,"
+        << "Stage1TimeMs,Stage2TimeMs,TotalTimeMs,KeywordsCount\n";
+}
+
+void writeResultRow(ostream& out, int line_id, const string& label,
+                    const string& predicted_label, const string& confidence,
+                    const string& severity_level, double stage1_time_ms,
+                    double stage2_time_ms, size_t keywords_count) {
+    out << line_id << ","
+        << label << ","
+        << predicted_label << ","
+        << confidence << ","
+        << severity_level << ","
+        << fixed << setprecision(3) << stage1_time_ms << ","
+        << fixed << setprecision(3) << stage2_time_ms << ","
+        << fixed << setprecision(3) << (stage1_time_ms + stage2_time_ms) << ","
+        << keywords_count << "\n";
+}
+
+void saveDetailedResults(const vector<LogEntry>& logs, const string& filename) {
+    ofstream out(filename);
+    
+    writeResultHeader(out);
+    for (const auto& log : logs) {
+        writeResultRow(out, log.line_id, log.label, log.predicted_label,
+                       log.confidence, log.severity_level, log.stage1_time_ms,
+                       log.stage2_time_ms, log.keywords.size());
+    }
+    
+    cout << "Detailed results saved to: " << filename << endl;
+}
+
+void printLabelDistribution(const StatsAccumulator& acc) {
+    cout << "\n--- Label Distribution ---" << endl;
+    
+    cout << "\nGround Truth:" << endl;
+    for (const auto& [label, count] : acc.ground_truth_dist) {
+        cout << "  " << (label.empty() || label == "-" ? "Normal (-)" : label) 
+             << ": " << count << endl;
+    }
+    
+    cout << "\nPredicted:" << endl;
+    for (const auto& [label, count] : acc.predicted_dist) {
+        cout << "  " << (label.empty() || label == "-" ? "Normal (-)" : label) 
+             << ": " << count << endl;
+    }
+}
+
+void printHeavyHitters(const HeavyHitters& hh) {
+    if (!hh.enabled()) return;
+    
+    auto print = [&](const string& title, const HeavyHitterTracker& tracker) {
+        cout << "\n" << title << ":" << endl;
+        for (const auto& e : tracker.top(hh.k)) {
+            cout << "  " << e.key << ": " << e.count;
+            if (e.lower_bound < e.count) cout << " (>= " << e.lower_bound << ")";
+            cout << endl;
+        }
+    };
+    
+    cout << "\n--- Heavy Hitters (top " << hh.k << ") ---" << endl;
+    print("Nodes", hh.nodes);
+    print("Templates", hh.templates);
+    print("Labels", hh.labels);
+}
+
+void printTopologySummary(const TopologyRollup& topo, size_t top_n = 5) {
+    if (!topo.enabled()) return;
+    
+    cout << "\n--- Topology (problem rows) ---" << endl;
+    const char* titles[] = {"Racks", "Midplanes", "Node cards"};
+    for (int level = 0; level < TopologyRollup::LEVEL_COUNT; level++) {
+        auto lvl = (TopologyRollup::Level)level;
+        vector<pair<uint64_t, size_t>> ranked;
+        for (size_t i = 0; i < topo.entries(lvl); i++) {
+            uint64_t p = topo.problems(lvl, i);
+            if (p > 0) ranked.push_back({p, i});
+        }
+        sort(ranked.begin(), ranked.end(), [](const pair<uint64_t, size_t>& a,
+                                              const pair<uint64_t, size_t>& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        
+        cout << titles[level] << ":";
+        for (size_t r = 0; r < min(top_n, ranked.size()); r++) {
+            cout << " " << TopologyRollup::locationName(lvl, ranked[r].second)
+                 << "=" << ranked[r].first;
+        }
+        cout << endl;
+    }
+    if (topo.unlocatedRows() > 0) {
+        cout << "Unlocated rows: " << topo.unlocatedRows() << endl;
+    }
+}
+
+void saveTopologyReport(const TopologyRollup& topo, const vector<string>& label_names,
+                        const string& filename) {
+    ofstream out(filename);
+    
+    out << "Level,Location,Rows,ProblemRows";
+    for (const auto& label : label_names) out << ",Label:" << label;
+    for (int sev = 0; sev < SEV_COUNT; sev++) out << ",Severity:" << kSeverityNames[sev];
+    out << "\n";
+    
+    const char* levels[] = {"rack", "midplane", "node_card"};
+    for (int level = 0; level < TopologyRollup::LEVEL_COUNT; level++) {
+        auto lvl = (TopologyRollup::Level)level;
+        for (size_t i = 0; i < topo.entries(lvl); i++) {
+            uint64_t rows = topo.total(lvl, i);
+            if (rows == 0) continue;
+            
+            const uint32_t* r = topo.row(lvl, i);
+            out << levels[level] << ","
+                << TopologyRollup::locationName(lvl, i) << ","
+                << rows << ","
+                << topo.problems(lvl, i);
+            for (size_t c = 0; c < topo.labelCount() + SEV_COUNT; c++) out << "," << r[c];
+            out << "\n";
+        }
+    }
+    
+    cout << "Topology rollups saved to: " << filename << endl;
+}
+
+// ============================================================================
+// Columnar Result Store
+// ============================================================================
+
+template <typename T>
+void writePod(ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readPod(istream& in, T& value) {
+    return bool(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+void writeArray(ostream& out, const vector<T>& values) {
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+bool readArray(istream& in, vector<T>& values, size_t count) {
+    values.resize(count);
+    return bool(in.read(reinterpret_cast<char*>(values.data()), count * sizeof(T)));
+}
+
+// Dictionary-encoded string column. Labels, confidences and severities
+// only take a handful of distinct values, so rows store a 16-bit code;
+// blocks are small enough that nodes and EventIds fit as well.
+class DictColumn {
+private:
+    unordered_map<string, uint16_t> index;
+    
+public:
+    vector<string> dict;
+    vector<uint16_t> codes;
+    
+    void push(const string& value) {
+        auto it = index.find(value);
+        if (it == index.end()) {
+            it = index.emplace(value, (uint16_t)dict.size()).first;
+            dict.push_back(value);
+        }
+        codes.push_back(it->second);
+    }
+    
+    const string& at(size_t row) const { return dict[codes[row]]; }
+    
+    // Code of `value` in this block, or -1 if it never occurs
+    int lookup(const string& value) const {
+        auto it = index.find(value);
+        return it == index.end() ? -1 : it->second;
+    }
+    
+    void clear() {
+        index.clear();
+        dict.clear();
+        codes.clear();
+    }
+    
+    void write(ostream& out) const {
+        writePod(out, (uint16_t)dict.size());
+        for (const auto& value : dict) {
+            writePod(out, (uint16_t)value.size());
+            out.write(value.data(), value.size());
+        }
+        writeArray(out, codes);
+    }
+    
+    bool read(istream& in, size_t rows) {
+        clear();
+        uint16_t dict_size = 0;
+        if (!readPod(in, dict_size)) return false;
+        for (uint16_t d = 0; d < dict_size; d++) {
+            uint16_t len = 0;
+            if (!readPod(in, len)) return false;
+            string value(len, '\0');
+            if (!in.read(&value[0], len)) return false;
+            index.emplace(value, d);
+            dict.push_back(value);
+        }
+        return readArray(in, codes, rows);
+    }
+};
+
+// Bloom filter over 64-bit key hashes, sized per block for ~1% false
+// positives. Probes use double hashing from a single hash.
+class BloomFilter {
+private:
+    vector<uint64_t> words;
+    static const int kHashes = 7;
+    
+    template <typename F>
+    bool probe(uint64_t h, F&& visit) const {
+        uint64_t mask = words.size() * 64 - 1;
+        uint64_t step = mix64(h) | 1;
+        for (int i = 0; i < kHashes; i++, h += step) {
+            if (!visit(h & mask)) return false;
+        }
+        return true;
+    }
+    
+public:
+    // At least 10 bits per expected key, rounded up to a power of two
+    void reset(size_t expected) {
+        size_t bits = 512;
+        while (bits < expected * 10) bits <<= 1;
+        words.assign(bits / 64, 0);
+    }
+    
+    void add(uint64_t h) {
+        probe(h, [this](uint64_t bit) {
+            words[bit >> 6] |= 1ULL << (bit & 63);
+            return true;
+        });
+    }
+    
+    bool mayContain(uint64_t h) const {
+        if (words.empty()) return false;
+        return probe(h, [this](uint64_t bit) {
+            return (words[bit >> 6] >> (bit & 63)) & 1;
+        });
+    }
+    
+    size_t memoryBytes() const { return words.size() * sizeof(uint64_t); }
+    
+    void write(ostream& out) const {
+        writePod(out, (uint32_t)words.size());
+        writeArray(out, words);
+    }
+    
+    bool read(istream& in) {
+        uint32_t count = 0;
+        return readPod(in, count) && readArray(in, words, count);
+    }
+};
+
+// Per-block zone map, stored ahead of the block payload so readers can
+// decide whether a block can match before decoding it.
+struct BlockSummary {
+    uint32_t rows = 0;
+    int64_t min_time = INT64_MAX;
+    int64_t max_time = INT64_MIN;
+    uint8_t severities = 0;   // bit per Severity
+    uint64_t labels = 0;      // bit per predicted label id
+    BloomFilter nodes;
+    BloomFilter keywords;
+    
+    void clear() {
+        rows = 0;
+        min_time = INT64_MAX;
+        max_time = INT64_MIN;
+        severities = 0;
+        labels = 0;
+    }
+    
+    void add(const LogEntry& log) {
+        rows++;
+        min_time = min(min_time, log.unix_time);
+        max_time = max(max_time, log.unix_time);
+        severities |= uint8_t(1u << log.severity_id);
+        labels |= 1ULL << (log.predicted_label_id & 63);
+    }
+    
+    bool overlaps(int64_t from, int64_t to) const {
+        return rows > 0 && min_time <= to && max_time >= from;
+    }
+    
+    void write(ostream& out) const {
+        writePod(out, rows);
+        writePod(out, min_time);
+        writePod(out, max_time);
+        writePod(out, severities);
+        writePod(out, labels);
+        nodes.write(out);
+        keywords.write(out);
+    }
+    
+    bool read(istream& in) {
+        return readPod(in, rows) && readPod(in, min_time) && readPod(in, max_time) &&
+               readPod(in, severities) && readPod(in, labels) &&
+               nodes.read(in) && keywords.read(in);
+    }
+};
+
+// A block of per-row results, stored column by column.
+struct ResultBlock {
+    vector<int32_t> line_id;
+    DictColumn label;
+    DictColumn predicted_label;
+    DictColumn confidence;
+    DictColumn severity_level;
+    vector<double> stage1_time_ms;
+    vector<double> stage2_time_ms;
+    vector<uint16_t> keywords_count;
+    vector<int64_t> unix_time;
+    vector<uint16_t> topology;
+    DictColumn node;
+    DictColumn event_id;
+    DictColumn component;
+    
+    size_t size() const { return line_id.size(); }
+    
+    void append(const LogEntry& log) {
+        line_id.push_back(log.line_id);
+        label.push(log.label);
+        predicted_label.push(log.predicted_label);
+        confidence.push(log.confidence);
+        severity_level.push(log.severity_level);
+        stage1_time_ms.push_back(log.stage1_time_ms);
+        stage2_time_ms.push_back(log.stage2_time_ms);
+        keywords_count.push_back((uint16_t)log.keywords.size());
+        unix_time.push_back(log.unix_time);
+        topology.push_back(log.topology);
+        node.push(log.node);
+        event_id.push(log.event_id);
+        component.push(log.component);
+    }
+    
+    void clear() {
+        line_id.clear();
+        label.clear();
+        predicted_label.clear();
+        confidence.clear();
+        severity_level.clear();
+        stage1_time_ms.clear();
+        stage2_time_ms.clear();
+        keywords_count.clear();
+        unix_time.clear();
+        topology.clear();
+        node.clear();
+        event_id.clear();
+        component.clear();
+    }
+    
+    void write(ostream& out) const {
+        writePod(out, (uint32_t)size());
+        writeArray(out, line_id);
+        label.write(out);
+        predicted_label.write(out);
+        confidence.write(out);
+        severity_level.write(out);
+        writeArray(out, stage1_time_ms);
+        writeArray(out, stage2_time_ms);
+        writeArray(out, keywords_count);
+        writeArray(out, unix_time);
+        writeArray(out, topology);
+        node.write(out);
+        event_id.write(out);
+        component.write(out);
+    }
+    
+    bool read(istream& in) {
+        uint32_t rows = 0;
+        if (!readPod(in, rows)) return false;
+        return readArray(in, line_id, rows) &&
+               label.read(in, rows) &&
+               predicted_label.read(in, rows) &&
+               confidence.read(in, rows) &&
+               severity_level.read(in, rows) &&
+               readArray(in, stage1_time_ms, rows) &&
+               readArray(in, stage2_time_ms, rows) &&
+               readArray(in, keywords_count, rows) &&
+               readArray(in, unix_time, rows) &&
+               readArray(in, topology, rows) &&
+               node.read(in, rows) &&
+               event_id.read(in, rows) &&
+               component.read(in, rows);
+    }
+    
+    void writeCSV(ostream& out) const {
+        for (size_t r = 0; r < size(); r++) {
+            writeResultRow(out, line_id[r], label.at(r), predicted_label.at(r),
+                           confidence.at(r), severity_level.at(r),
+                           stage1_time_ms[r], stage2_time_ms[r], keywords_count[r]);
+        }
+    }
+};
+
+// Store file layout: magic and the predicted label names, then blocks of
+// up to kBlockRows rows in input order. Each block is a length-prefixed
+// BlockSummary followed by the length-prefixed column payload, so readers
+// can check the summary and seek past blocks that cannot match. Row n of
+// the store is row id n of the inverted index.
+static const char kStoreMagic[8] = {'S', 'D', 'C', 'O', 'L', '2', 0, 0};
+
+// Writes processed rows to a store file. Used both for the persistent
+// result store (--store) and as the spill file under --memory-limit, in
+// which case it is removed once merged into scenario_d_results.csv.
+class ResultStoreWriter {
+private:
+    string path;
+    ofstream out;
+    bool keep;
+    ResultBlock block;
+    BlockSummary summary;
+    vector<uint64_t> keyword_hashes;
+    string buffer;
+    size_t block_rows;
+    size_t blocks = 0;
+    uint64_t file_bytes = 0;
+    
+    void writeSection(const string& bytes) {
+        writePod(out, (uint64_t)bytes.size());
+        out.write(bytes.data(), bytes.size());
+        file_bytes += sizeof(uint64_t) + bytes.size();
+    }
+    
+    void flushBlock() {
+        if (block.size() == 0) return;
+        
+        summary.nodes.reset(block.node.dict.size());
+        for (const auto& node : block.node.dict) summary.nodes.add(hashKey(node));
+        sort(keyword_hashes.begin(), keyword_hashes.end());
+        keyword_hashes.erase(unique(keyword_hashes.begin(), keyword_hashes.end()),
+                             keyword_hashes.end());
+        summary.keywords.reset(keyword_hashes.size());
+        for (uint64_t h : keyword_hashes) summary.keywords.add(h);
+        
+        ostringstream header;
+        summary.write(header);
+        writeSection(header.str());
+        
+        ostringstream payload;
+        block.write(payload);
+        buffer = payload.str();
+        writeSection(buffer);
+        
+        block.clear();
+        summary.clear();
+        keyword_hashes.clear();
+        blocks++;
+    }
+    
+public:
+    static constexpr size_t kBlockRows = 32768;
+    
+    // Rough cost of one buffered row: its column entries and keyword
+    // hashes, plus the encoded payload held twice while the block flushes.
+    static constexpr size_t kBlockRowBytes = 256;
+    
+    // Block size whose buffers fit in `budget_bytes` (0 = no limit)
+    static size_t blockRowsFor(size_t budget_bytes) {
+        if (budget_bytes == 0) return kBlockRows;
+        return max<size_t>(1024, min(kBlockRows, budget_bytes / kBlockRowBytes));
+    }
+    
+    ResultStoreWriter(const string& store_path, bool keep_file,
+                      const vector<string>& label_names, size_t rows_per_block = kBlockRows)
+        : path(store_path), out(store_path, ios::binary | ios::trunc), keep(keep_file),
+          block_rows(rows_per_block) {
+        ostringstream header;
+        header.write(kStoreMagic, sizeof(kStoreMagic));
+        writePod(header, (uint8_t)label_names.size());
+        for (const auto& name : label_names) {
+            writePod(header, (uint16_t)name.size());
+            header.write(name.data(), name.size());
+        }
+        buffer = header.str();
+        out.write(buffer.data(), buffer.size());
+        file_bytes = buffer.size();
+    }
+    
+    // Reopens a kept store after a restart, dropping anything written
+    // past the last checkpoint (`committed_bytes`, `committed_blocks`).
+    ResultStoreWriter(const string& store_path, uint64_t committed_bytes, size_t committed_blocks,
+                      size_t rows_per_block = kBlockRows)
+        : path(store_path), keep(true), block_rows(rows_per_block), blocks(committed_blocks),
+          file_bytes(committed_bytes) {
+        if (truncate(store_path.c_str(), committed_bytes) == 0) {
+            out.open(store_path, ios::binary | ios::app);
+        }
+    }
+    
+    ~ResultStoreWriter() {
+        if (!keep) remove(path.c_str());
+    }
+    
+    bool isOpen() const { return out.is_open(); }
+    const string& filename() const { return path; }
+    size_t blockCount() const { return blocks; }
+    
+    void append(const vector<LogEntry>& logs) {
+        for (const auto& log : logs) {
+            block.append(log);
+            summary.add(log);
+            for (const auto& kw : log.keywords) keyword_hashes.push_back(hashKey(kw));
+            if (block.size() == block_rows) flushBlock();
+        }
+    }
+    
+    // Writes out the partial block, flushes and fsyncs, so every appended
+    // row is durable before a checkpoint names it. False on a write error.
+    bool commit() {
+        flushBlock();
+        if (!out.flush()) return false;
+        // ofstream exposes no descriptor; fsync through a second one
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        bool synced = fsync(fd) == 0;
+        close(fd);
+        return synced;
+    }
+    
+    // File length covering every appended row as of the last commit()
+    uint64_t committedBytes() const { return file_bytes; }
+    
+    void finish() {
+        flushBlock();
+        out.close();
+    }
+    
+    void mergeInto(const string& filename);
+};
+
+// Reads a store block by block: nextSummary() yields the zone map of the
+// next block, after which the caller either decodes it with readBlock() or
+// seeks past it with skipBlock().
+class ResultStoreReader {
+private:
+    ifstream in;
+    vector<string> label_names;
+    uint64_t block_start = 0;
+    uint64_t rows_before = 0;   // rows in blocks already read or skipped
+    uint64_t payload_bytes = 0;
+    bool pending = false;       // summary read, payload not yet consumed
+    string buffer;
+    
+    bool readSection(string& bytes) {
+        uint64_t size = 0;
+        if (!readPod(in, size)) return false;
+        bytes.resize(size);
+        return bool(in.read(&bytes[0], size));
+    }
+    
+public:
+    bool open(const string& path) {
+        in.open(path, ios::binary);
+        char magic[sizeof(kStoreMagic)];
+        if (!in.read(magic, sizeof(magic)) || memcmp(magic, kStoreMagic, sizeof(magic)) != 0) {
+            return false;
+        }
+        uint8_t label_count = 0;
+        if (!readPod(in, label_count)) return false;
+        for (uint8_t l = 0; l < label_count; l++) {
+            uint16_t len = 0;
+            if (!readPod(in, len)) return false;
+            string name(len, '\0');
+            if (!in.read(&name[0], len)) return false;
+            label_names.push_back(name);
+        }
+        return true;
+    }
+    
+    // Predicted label names; bit i of BlockSummary::labels is label_names[i]
+    const vector<string>& labelNames() const { return label_names; }
+    
+    // First row id of the block whose summary was most recently read
+    uint64_t blockStart() const { return block_start; }
+    
+    bool nextSummary(BlockSummary& summary) {
+        if (pending) skipBlock();
+        if (!readSection(buffer)) return false;
+        istringstream header(buffer);
+        if (!summary.read(header) || !readPod(in, payload_bytes)) return false;
+        block_start = rows_before;
+        rows_before += summary.rows;
+        pending = true;
+        return true;
+    }
+    
+    bool readBlock(ResultBlock& block) {
+        if (!pending) return false;
+        pending = false;
+        buffer.resize(payload_bytes);
+        if (!in.read(&buffer[0], payload_bytes)) return false;
+        istringstream payload(buffer);
+        return block.read(payload);
+    }
+    
+    void skipBlock() {
+        if (!pending) return;
+        pending = false;
+        in.seekg(payload_bytes, ios::cur);
+    }
+    
+    bool next(ResultBlock& block, uint64_t& first_row) {
+        BlockSummary summary;
+        if (!nextSummary(summary) || !readBlock(block)) return false;
+        first_row = block_start;
+        return true;
+    }
+};
+
+void ResultStoreWriter::mergeInto(const string& filename) {
+    finish();
+    
+    ResultStoreReader reader;
+    ofstream csv(filename);
+    writeResultHeader(csv);
+    
+    size_t merged = 0;
+    if (reader.open(path)) {
+        uint64_t first_row = 0;
+        while (reader.next(block, first_row)) {
+            block.writeCSV(csv);
+            merged++;
+        }
+    }
+    if (merged != blocks) {
+        cerr << "Warning: Merged " << merged << " of " << blocks
+             << " stored blocks" << endl;
+    }
+    
+    cout << "Detailed results saved to: " << filename
+         << " (merged " << merged << " blocks)" << endl;
+}
+
+// ============================================================================
+// Inverted Index
+// ============================================================================
+
+inline void putVarint(string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(char((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+inline uint64_t getVarint(const uint8_t*& p) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (*p & 0x80) {
+        v |= uint64_t(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    v |= uint64_t(*p++) << shift;
+    return v;
+}
+
+// Term kinds share one dictionary; the kind is the first byte of the key
+static const char TERM_KEYWORD = 'k';
+static const char TERM_EVENT = 'e';
+
+// Delta + varint encoded list of ascending row ids
+struct PostingList {
+    string bytes;
+    uint32_t count = 0;
+    uint32_t last_row = 0;
+    
+    void append(uint32_t row) {
+        putVarint(bytes, count == 0 ? row : row - last_row);
+        last_row = row;
+        count++;
+    }
+    
+    vector<uint32_t> decode() const {
+        vector<uint32_t> rows;
+        rows.reserve(count);
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes.data());
+        uint32_t row = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            row = (i == 0) ? (uint32_t)getVarint(p) : row + (uint32_t)getVarint(p);
+            rows.push_back(row);
+        }
+        return rows;
+    }
+};
+
+// Builds an index from extracted keywords and EventIds to row ids while
+// Stage 1 runs. Threads collect raw postings; after each segment they are
+// sorted and appended to the compressed lists, so row ids stay ascending
+// and the raw buffers stay segment-sized.
+class InvertedIndexBuilder {
+private:
+    struct alignas(64) ThreadPostings {
+        unordered_map<string, vector<uint32_t>> terms;
+    };
+    
+    vector<ThreadPostings> threads;
+    map<string, PostingList> postings;
+    
+    // Row table: lets queries filter by time and location without
+    // touching the results
+    vector<int32_t> line_ids;
+    vector<int64_t> unix_times;
+    vector<uint16_t> topologies;
+    vector<uint32_t> node_codes;
+    vector<string> node_names;
+    unordered_map<string, uint32_t> node_index;
+    
+    static string termKey(char kind, const string& term) {
+        string key(1, kind);
+        key += term;
+        return key;
+    }
+    
+public:
+    explicit InvertedIndexBuilder(int num_threads) : threads(num_threads) {}
+    
+    // Called from the processing loop by thread `tid`
+    void add(int tid, uint32_t row, const LogEntry& log) {
+        auto& terms = threads[tid].terms;
+        for (const auto& kw : log.keywords) {
+            terms[termKey(TERM_KEYWORD, kw)].push_back(row);
+        }
+        if (!log.event_id.empty()) {
+            terms[termKey(TERM_EVENT, log.event_id)].push_back(row);
+        }
+    }
+    
+    // Serial: records the segment's row table and compresses postings
+    void flushSegment(const vector<LogEntry>& logs) {
+        for (const auto& log : logs) {
+            line_ids.push_back(log.line_id);
+            unix_times.push_back(log.unix_time);
+            topologies.push_back(log.topology);
+            
+            auto it = node_index.find(log.node);
+            if (it == node_index.end()) {
+                it = node_index.emplace(log.node, (uint32_t)node_names.size()).first;
+                node_names.push_back(log.node);
+            }
+            node_codes.push_back(it->second);
+        }
+        
+        unordered_map<string, vector<uint32_t>> segment;
+        for (auto& t : threads) {
+            for (auto& [key, rows] : t.terms) {
+                auto& dst = segment[key];
+                dst.insert(dst.end(), rows.begin(), rows.end());
+            }
+            t.terms.clear();
+        }
+        for (auto& [key, rows] : segment) {
+            sort(rows.begin(), rows.end());
+            PostingList& list = postings[key];
+            for (uint32_t row : rows) list.append(row);
+        }
+    }
+    
+    size_t termCount() const { return postings.size(); }
+    
+    bool save(const string& filename) const {
+        ofstream out(filename, ios::binary | ios::trunc);
+        if (!out) return false;
+        
+        out.write("SDIDX1\0\0", 8);
+        writePod(out, (uint64_t)line_ids.size());
+        writeArray(out, line_ids);
+        writeArray(out, unix_times);
+        writeArray(out, topologies);
+        writeArray(out, node_codes);
+        
+        writePod(out, (uint32_t)node_names.size());
+        for (const auto& name : node_names) {
+            writePod(out, (uint16_t)name.size());
+            out.write(name.data(), name.size());
+        }
+        
+        writePod(out, (uint32_t)postings.size());
+        for (const auto& [key, list] : postings) {
+            writePod(out, (uint16_t)key.size());
+            out.write(key.data(), key.size());
+            writePod(out, list.count);
+            writePod(out, (uint32_t)list.bytes.size());
+            out.write(list.bytes.data(), list.bytes.size());
+        }
+        return bool(out);
+    }
+};
+
+// Read side of scenario_d_index.bin
+struct InvertedIndex {
+    vector<int32_t> line_ids;
+    vector<int64_t> unix_times;
+    vector<uint16_t> topologies;
+    vector<uint32_t> node_codes;
+    vector<string> node_names;
+    unordered_map<string, PostingList> postings;
+    
+    size_t rows() const { return line_ids.size(); }
+    
+    bool load(const string& filename) {
+        ifstream in(filename, ios::binary);
+        char magic[8];
+        if (!in.read(magic, 8) || memcmp(magic, "SDIDX1", 6) != 0) return false;
+        
+        uint64_t n = 0;
+        if (!readPod(in, n)) return false;
+        if (!readArray(in, line_ids, n) || !readArray(in, unix_times, n) ||
+            !readArray(in, topologies, n) || !readArray(in, node_codes, n)) {
+            return false;
+        }
+        
+        uint32_t nodes = 0;
+        if (!readPod(in, nodes)) return false;
+        node_names.resize(nodes);
+        for (auto& name : node_names) {
+            uint16_t len = 0;
+            if (!readPod(in, len)) return false;
+            name.resize(len);
+            if (len && !in.read(&name[0], len)) return false;
+        }
+        
+        uint32_t terms = 0;
+        if (!readPod(in, terms)) return false;
+        for (uint32_t t = 0; t < terms; t++) {
+            uint16_t len = 0;
+            uint32_t bytes = 0;
+            string key;
+            PostingList list;
+            if (!readPod(in, len)) return false;
+            key.resize(len);
+            if (len && !in.read(&key[0], len)) return false;
+            if (!readPod(in, list.count) || !readPod(in, bytes)) return false;
+            list.bytes.resize(bytes);
+            if (bytes && !in.read(&list.bytes[0], bytes)) return false;
+            postings.emplace(move(key), move(list));
+        }
+        return true;
+    }
+    
+    const PostingList* find(char kind, const string& term) const {
+        string key(1, kind);
+        key += term;
+        auto it = postings.find(key);
+        return it == postings.end() ? nullptr : &it->second;
+    }
+};
+
+// ============================================================================
+// Metrics Endpoint
+// ============================================================================
+
+// Stage latency histogram bounds in milliseconds (last bucket is +Inf)
+static const double kLatencyBucketsMs[] = {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+static const int kLatencyBuckets = sizeof(kLatencyBucketsMs) / sizeof(kLatencyBucketsMs[0]);
+static const int kMaxMetricLabels = 64;
+
+// Counters owned by one OpenMP thread. Only the owner writes them, with a
+// relaxed load + store rather than a locked read-modify-write, so the hot
+// loop never contends; the scrape thread reads and sums all threads.
+struct alignas(64) ThreadMetrics {
+    atomic<uint64_t> rows{0};
+    atomic<uint64_t> stage_ns[2]{};
+    atomic<uint64_t> stage_buckets[2][kLatencyBuckets + 1]{};
+    atomic<uint64_t> labels[kMaxMetricLabels]{};
+    
+    static void bump(atomic<uint64_t>& counter, uint64_t delta = 1) {
+        counter.store(counter.load(memory_order_relaxed) + delta, memory_order_relaxed);
+    }
+    
+    void observeStage(int stage, double ms) {
+        bump(stage_ns[stage], (uint64_t)(ms * 1e6));
+        int b = int(lower_bound(kLatencyBucketsMs, kLatencyBucketsMs + kLatencyBuckets, ms) - 
+                    kLatencyBucketsMs);
+        bump(stage_buckets[stage][b]);
+    }
+};
+
+// Current resident set size from /proc (0 where unavailable)
+uint64_t residentBytes() {
+    ifstream statm("/proc/self/statm");
+    uint64_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+// Peak resident set size at full resolution, unlike peakMemoryMB()
+uint64_t peakResidentBytes() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    #ifdef __APPLE__
+        return usage.ru_maxrss;                   // Mac: bytes
+    #else
+        return usage.ru_maxrss * 1024ULL;         // Linux: KB
+    #endif
+}
+
+class PipelineMetrics {
+private:
+    vector<unique_ptr<ThreadMetrics>> threads;
+    vector<string> label_names;
+    chrono::steady_clock::time_point start;
+    vector<function<void(ostream&)>> collectors;
+    
+    // Upper bound of the bucket holding quantile q, interpolated linearly
+    static double quantile(const uint64_t* buckets, double q) {
+        uint64_t total = 0;
+        for (int b = 0; b <= kLatencyBuckets; b++) total += buckets[b];
+        if (total == 0) return 0;
+        
+        double target = q * total;
+        uint64_t seen = 0;
+        for (int b = 0; b < kLatencyBuckets; b++) {
+            if (seen + buckets[b] >= target) {
+                double lower = b == 0 ? 0 : kLatencyBucketsMs[b - 1];
+                double fraction = buckets[b] ? (target - seen) / buckets[b] : 1;
+                return lower + (kLatencyBucketsMs[b] - lower) * fraction;
+            }
+            seen += buckets[b];
+        }
+        return kLatencyBucketsMs[kLatencyBuckets - 1];
+    }
+    
+public:
+    PipelineMetrics(int num_threads, const vector<string>& labels)
+        : label_names(labels), start(chrono::steady_clock::now()) {
+        for (int t = 0; t < num_threads; t++) threads.emplace_back(new ThreadMetrics());
+    }
+    
+    // Called from the processing loop by thread `tid`
+    void observe(int tid, const LogEntry& log) {
+        ThreadMetrics& m = *threads[tid];
+        ThreadMetrics::bump(m.rows);
+        m.observeStage(0, log.stage1_time_ms);
+        m.observeStage(1, log.stage2_time_ms);
+        ThreadMetrics::bump(m.labels[log.predicted_label_id % kMaxMetricLabels]);
+    }
+    
+    // Extra samples from the embedding mode (queues, ingestion counters)
+    void addCollector(function<void(ostream&)> collector) {
+        collectors.push_back(move(collector));
+    }
+    
+    // Prometheus text exposition format
+    void render(ostream& out) const {
+        uint64_t rows = 0;
+        uint64_t stage_ns[2] = {0, 0};
+        uint64_t buckets[2][kLatencyBuckets + 1] = {};
+        vector<uint64_t> labels(label_names.size(), 0);
+        for (const auto& t : threads) {
+            rows += t->rows.load(memory_order_relaxed);
+            for (int s = 0; s < 2; s++) {
+                stage_ns[s] += t->stage_ns[s].load(memory_order_relaxed);
+                for (int b = 0; b <= kLatencyBuckets; b++) {
+                    buckets[s][b] += t->stage_buckets[s][b].load(memory_order_relaxed);
+                }
+            }
+            for (size_t l = 0; l < labels.size() && l < (size_t)kMaxMetricLabels; l++) {
+                labels[l] += t->labels[l].load(memory_order_relaxed);
+            }
+        }
+        double uptime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        static const char* const stages[2] = {"stage1", "stage2"};
+        
+        out << fixed << setprecision(6);
+        out << "# HELP scenario_d_rows_total Rows processed.\n";
+        out << "# TYPE scenario_d_rows_total counter\n";
+        out << "scenario_d_rows_total " << rows << "\n";
+        out << "# HELP scenario_d_rows_per_second Rows processed per second since start.\n";
+        out << "# TYPE scenario_d_rows_per_second gauge\n";
+        out << "scenario_d_rows_per_second " << rows / max(uptime, 1e-9) << "\n";
+        
+        out << "# HELP scenario_d_stage_seconds_total Thread time spent per stage.\n";
+        out << "# TYPE scenario_d_stage_seconds_total counter\n";
+        for (int s = 0; s < 2; s++) {
+            out << "scenario_d_stage_seconds_total{stage=\"" << stages[s] << "\"} " 
+                << stage_ns[s] / 1e9 << "\n";
+        }
+        out << "# HELP scenario_d_stage_rows_per_second Rows per thread-second of stage time.\n";
+        out << "# TYPE scenario_d_stage_rows_per_second gauge\n";
+        for (int s = 0; s < 2; s++) {
+            out << "scenario_d_stage_rows_per_second{stage=\"" << stages[s] << "\"} " 
+                << (stage_ns[s] ? rows / (stage_ns[s] / 1e9) : 0.0) << "\n";
+        }
+        
+        out << "# HELP scenario_d_stage_latency_ms Per-row stage latency.\n";
+        out << "# TYPE scenario_d_stage_latency_ms histogram\n";
+        for (int s = 0; s < 2; s++) {
+            uint64_t cumulative = 0;
+            for (int b = 0; b <= kLatencyBuckets; b++) {
+                cumulative += buckets[s][b];
+                out << "scenario_d_stage_latency_ms_bucket{stage=\"" << stages[s] << "\",le=\"";
+                if (b < kLatencyBuckets) out << kLatencyBucketsMs[b];
+                else out << "+Inf";
+                out << "\"} " << cumulative << "\n";
+            }
+            out << "scenario_d_stage_latency_ms_sum{stage=\"" << stages[s] << "\"} " 
+                << stage_ns[s] / 1e6 << "\n";
+            out << "scenario_d_stage_latency_ms_count{stage=\"" << stages[s] << "\"} " 
+                << cumulative << "\n";
+        }
+        out << "# HELP scenario_d_stage_latency_p99_ms 99th percentile stage latency, from the histogram.\n";
+        out << "# TYPE scenario_d_stage_latency_p99_ms gauge\n";
+        for (int s = 0; s < 2; s++) {
+            out << "scenario_d_stage_latency_p99_ms{stage=\"" << stages[s] << "\"} " 
+                << quantile(buckets[s], 0.99) << "\n";
+        }
+        
+        out << "# HELP scenario_d_label_rows_total Rows per predicted label.\n";
+        out << "# TYPE scenario_d_label_rows_total counter\n";
+        for (size_t l = 0; l < labels.size(); l++) {
+            out << "scenario_d_label_rows_total{label=\"" << label_names[l] << "\"} " 
+                << labels[l] << "\n";
+        }
+        
+        // The kernel's high-water mark can trail the live RSS slightly
+        uint64_t resident = residentBytes();
+        out << "# HELP scenario_d_resident_memory_bytes Resident set size.\n";
+        out << "# TYPE scenario_d_resident_memory_bytes gauge\n";
+        out << "scenario_d_resident_memory_bytes " << resident << "\n";
+        out << "# HELP scenario_d_peak_resident_memory_bytes Peak resident set size.\n";
+        out << "# TYPE scenario_d_peak_resident_memory_bytes gauge\n";
+        out << "scenario_d_peak_resident_memory_bytes " << max(resident, peakResidentBytes()) << "\n";
+        out << "# HELP scenario_d_uptime_seconds Seconds since start.\n";
+        out << "# TYPE scenario_d_uptime_seconds gauge\n";
+        out << "scenario_d_uptime_seconds " << uptime << "\n";
+        
+        for (const auto& collect : collectors) collect(out);
+    }
+};
+
+// Minimal HTTP/1.0 server for GET /metrics on its own thread. Each scrape
+// aggregates the per-thread counters at that moment.
+class MetricsServer {
+private:
+    int fd = -1;
+    thread worker;
+    atomic<bool> stopping{false};
+    const PipelineMetrics& metrics;
+    
+    void handle(int conn) {
+        char request[1024];
+        ssize_t n = read(conn, request, sizeof(request) - 1);
+        if (n <= 0) return;
+        request[n] = '\0';
+        
+        string status = "200 OK";
+        string body;
+        if (strncmp(request, "GET /metrics", 12) == 0) {
+            ostringstream out;
+            metrics.render(out);
+            body = out.str();
+        } else {
+            status = "404 Not Found";
+            body = "Try /metrics\n";
+        }
+        string response = "HTTP/1.0 " + status + "\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " + to_string(body.size()) + "\r\n"
+            "Connection: close\r\n\r\n" + body;
+        const char* p = response.data();
+        size_t left = response.size();
+        while (left > 0) {
+            ssize_t w = write(conn, p, left);
+            if (w <= 0) break;
+            p += w;
+            left -= w;
+        }
+    }
+    
+    void run() {
+        pollfd pfd{fd, POLLIN, 0};
+        while (!stopping) {
+            if (::poll(&pfd, 1, 200) <= 0) continue;
+            int conn = accept(fd, nullptr, nullptr);
+            if (conn < 0) continue;
+            handle(conn);
+            close(conn);
+        }
+    }
+    
+public:
+    explicit MetricsServer(const PipelineMetrics& m) : metrics(m) {}
+    
+    ~MetricsServer() {
+        stopping = true;
+        if (worker.joinable()) worker.join();
+        if (fd >= 0) close(fd);
+    }
+    
+    // Listens on localhost only
+    bool start(int port) {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+            ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            listen(fd, 16) != 0) {
+            return false;
+        }
+        worker = thread([this]() { run(); });
+        return true;
+    }
+};
+
+// ============================================================================
+// Processing Pipeline
+// ============================================================================
+
+// Rough resident cost of one row beyond its raw line: LogEntry itself,
+// heap-allocated strings and up to 10 keywords.
+static constexpr size_t kRowOverheadBytes = sizeof(LogEntry) + 192;
+
+// Reads rows until the estimated size of the segment reaches `budget_bytes`
+// (0 = read everything). Returns the number of rows read.
+size_t readSegment(CSVReader& reader, vector<LogEntry>& logs, size_t budget_bytes) {
+    logs.clear();
+    
+    size_t bytes = 0;
+    size_t line_bytes = 0;
+    LogEntry log;
+    while ((budget_bytes == 0 || bytes < budget_bytes) && reader.next(log, &line_bytes)) {
+        bytes += line_bytes + kRowOverheadBytes;
+        logs.push_back(move(log));
+    }
+    return logs.size();
+}
+
+// Cheap stand-in for Stage 1 under overload: the result of the first
+// fully analyzed row of each (EventId, level) is reused for later rows of
+// the same template. Filled serially between segments and only read
+// inside the parallel loop.
+class TemplateCache {
+private:
+    struct Entry {
+        string label;
+        string confidence;
+        string issue_category;
+        uint8_t label_id;
+    };
+    unordered_map<string, Entry> entries;
+    static const size_t kMaxEntries = 1 << 16;
+    
+    static string key(const LogEntry& log) {
+        return log.event_id + '\x1f' + log.level;
+    }
+    
+public:
+    size_t size() const { return entries.size(); }
+    
+    bool contains(const LogEntry& log) const {
+        return !log.event_id.empty() && entries.count(key(log)) > 0;
+    }
+    
+    // Serial: remembers results of analyzed rows
+    void learn(const vector<LogEntry>& logs) {
+        for (const auto& log : logs) {
+            if (log.event_id.empty() || entries.size() >= kMaxEntries) continue;
+            entries.emplace(key(log), Entry{log.predicted_label, log.confidence, 
+                                            log.issue_category, log.predicted_label_id});
+        }
+    }
+    
+    // Fills in Stage 1 results from the cache; false if the template is unknown
+    bool classify(LogEntry& log, const RuleEngine& engine) const {
+        if (log.event_id.empty()) return false;
+        auto it = entries.find(key(log));
+        if (it == entries.end()) return false;
+        
+        auto start = chrono::high_resolution_clock::now();
+        log.predicted_label = it->second.label;
+        log.predicted_label_id = it->second.label_id;
+        log.confidence = it->second.confidence;
+        log.severity_id = engine.determineSeverity(log.level);
+        log.severity_level = kSeverityNames[log.severity_id];
+        log.affected_component = log.component;
+        log.issue_category = it->second.issue_category;
+        log.keywords.clear();
+        auto end = chrono::high_resolution_clock::now();
+        log.stage1_time_ms = chrono::duration<double, milli>(end - start).count();
+        return true;
+    }
+};
+
+// Everything the processing loop touches besides the rows themselves
+struct PipelineContext {
+    RuleEngine& rule_engine;
+    ReportGenerator& report_gen;
+    vector<ThreadAggregates>& aggregates;   // one per OpenMP thread
+    BurstDetector* bursts;                  // shared; nullptr = disabled
+    InvertedIndexBuilder* index;            // nullptr = disabled
+    bool progress = true;                   // print "Processed:" lines
+    PipelineMetrics* metrics = nullptr;     // per-thread counters for scrapes
+    const TemplateCache* template_cache = nullptr;   // set while shedding load
+    bool dedup = false;                     // analyze repeated Content once per segment
+};
+
+// Maps every row to the first row of the segment with the same Content
+// and Level (itself if none). Hashes are computed in parallel; the
+// grouping pass is serial but touches one 64-bit key per row.
+vector<uint32_t> groupIdenticalContent(const vector<LogEntry>& logs) {
+    vector<uint64_t> hashes(logs.size());
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < logs.size(); i++) {
+        hashes[i] = mix64(hashKey(logs[i].content) ^ (hashKey(logs[i].level) * 0x9e3779b97f4a7c15ULL));
+    }
+    
+    vector<uint32_t> source(logs.size());
+    unordered_map<uint64_t, uint32_t> first_seen;
+    first_seen.reserve(logs.size());
+    for (size_t i = 0; i < logs.size(); i++) {
+        auto it = first_seen.emplace(hashes[i], (uint32_t)i).first;
+        const LogEntry& first = logs[it->second];
+        // A hash collision between different messages is analyzed on its own
+        bool same = first.content == logs[i].content && first.level == logs[i].level;
+        source[i] = same ? it->second : (uint32_t)i;
+    }
+    return source;
+}
+
+// Fans Stage 1 results of `src` out to an identical row
+void copyStage1(LogEntry& log, const LogEntry& src) {
+    auto start = chrono::high_resolution_clock::now();
+    log.predicted_label = src.predicted_label;
+    log.predicted_label_id = src.predicted_label_id;
+    log.confidence = src.confidence;
+    log.severity_id = src.severity_id;
+    log.severity_level = src.severity_level;
+    log.affected_component = log.component;
+    log.issue_category = src.issue_category;
+    log.keywords = src.keywords;
+    log.fast_path = src.fast_path;
+    log.deduplicated = true;
+    auto end = chrono::high_resolution_clock::now();
+    log.stage1_time_ms = chrono::duration<double, milli>(end - start).count();
+}
+
+// Runs Stage 1 and Stage 2 over one segment. Returns wall time in seconds.
+double processSegment(vector<LogEntry>& logs, PipelineContext& ctx, size_t row_offset) {
+    auto start = chrono::high_resolution_clock::now();
+    
+    // With dedup, only the first row of each identical group is analyzed
+    vector<uint32_t> source;
+    if (ctx.dedup) source = groupIdenticalContent(logs);
+    
+    #pragma omp parallel
+    {
+        RowArena arena;
+        int tid = omp_get_thread_num();
+        ThreadAggregates& agg = ctx.aggregates[tid];
+        
+        // Stage 1: Rule-based analysis, unless the template cache
+        // already knows the answer
+        auto analyze = [&](LogEntry& log) {
+            if (!ctx.template_cache || !ctx.template_cache->classify(log, ctx.rule_engine)) {
+                ctx.rule_engine.analyze(log, arena);
+                arena.reset();
+            }
+        };
+        
+        if (!source.empty()) {
+            #pragma omp for schedule(dynamic, 10)
+            for (size_t i = 0; i < logs.size(); i++) {
+                if (source[i] == i) analyze(logs[i]);
+            }
+        }
+        
+        #pragma omp for schedule(dynamic, 10)
+        for (size_t i = 0; i < logs.size(); i++) {
+            if (source.empty()) {
+                analyze(logs[i]);
+            } else if (source[i] != i) {
+                copyStage1(logs[i], logs[source[i]]);
+            }
+            
+            // Stage 2: Report generation
+            ctx.report_gen.generate(logs[i]);
+            
+            // Streaming aggregates
+            agg.observe(logs[i]);
+            if (ctx.bursts) ctx.bursts->observe(logs[i]);
+            if (ctx.index) ctx.index->add(tid, (uint32_t)(row_offset + i), logs[i]);
+            
+            // Calculate total time
+            logs[i].total_time_ms = logs[i].stage1_time_ms + logs[i].stage2_time_ms;
+            if (ctx.metrics) ctx.metrics->observe(tid, logs[i]);
+            
+            // Progress display (every 100 logs)
+            size_t row = row_offset + i;
+            if (ctx.progress && row % 100 == 0 && row > 0) {
+                #pragma omp critical
+                {
+                    cout << "  Processed: " << row << "/" << row_offset + logs.size() << endl;
+                }
+            }
+        }
+    }
+    
+    auto end = chrono::high_resolution_clock::now();
+    return chrono::duration<double>(end - start).count();
+}
+
+// Rows timed per candidate by --calibrate
+static constexpr size_t kCalibrationRows = 20000;
+
+// Runs a sample of `logs` at 1, 2, 4, ... up to `max_threads` threads and
+// returns the count with the best throughput. Results are thrown away; a
+// first untimed pass warms the token cache and the OpenMP pool.
+int calibrateThreads(const vector<LogEntry>& logs, RuleEngine& engine,
+                     const AggregateConfig& agg_cfg, bool dedup, int max_threads) {
+    vector<LogEntry> sample(logs.begin(), logs.begin() + min(logs.size(), kCalibrationRows));
+    ReportGenerator report_gen;
+    
+    vector<int> candidates;
+    for (int t = 1; t < max_threads; t *= 2) candidates.push_back(t);
+    candidates.push_back(max_threads);
+    
+    auto measure = [&](int threads) {
+        omp_set_num_threads(threads);
+        vector<ThreadAggregates> aggregates(threads, ThreadAggregates(agg_cfg));
+        PipelineContext ctx{engine, report_gen, aggregates, nullptr, nullptr};
+        ctx.progress = false;
+        ctx.dedup = dedup;
+        vector<LogEntry> rows = sample;
+        return rows.size() / processSegment(rows, ctx, 0);
+    };
+    measure(max_threads);
+    
+    int best = max_threads;
+    double best_rate = 0;
+    for (int threads : candidates) {
+        double rate = measure(threads);
+        cout << "  " << setw(4) << threads << " threads: " << fixed << setprecision(0) 
+             << rate << " logs/sec" << endl;
+        if (rate > best_rate) {
+            best_rate = rate;
+            best = threads;
+        }
+    }
+    return best;
+}
+
+// ============================================================================
+// Checkpointing
+// ============================================================================
+
+// Without --memory-limit, checkpointed runs still commit in segments of
+// roughly this many bytes of rows.
+static constexpr size_t kCheckpointSegmentBytes = 64 * 1024 * 1024;
+
+static const char kCheckpointMagic[8] = {'S', 'D', 'C', 'K', 'P', 'T', '1', 0};
+
+// A committed prefix of the run: every row up to `rows` is in the result
+// store, whose first `store_bytes` bytes cover exactly those rows.
+struct CheckpointRecord {
+    char magic[8];
+    uint64_t input_size;       // detects resuming against a different input
+    uint64_t input_offset;     // reader position after the last committed row
+    uint64_t rows;
+    uint64_t store_bytes;
+    uint64_t store_blocks;
+    uint64_t segments;
+    double processing_sec;     // processing time spent so far
+    uint64_t checksum;
+    
+    uint64_t computeChecksum() const {
+        uint64_t h = 0;
+        const char* bytes = reinterpret_cast<const char*>(this);
+        for (size_t i = 0; i < offsetof(CheckpointRecord, checksum); i += 8) {
+            uint64_t word;
+            memcpy(&word, bytes + i, 8);
+            h = mix64(h ^ word);
+        }
+        return h;
+    }
+};
+
+// Append-only log of checkpoint records. A record is only written after
+// the store data it covers has been fsynced, so the last intact record is
+// always a consistent resume point; a torn final record fails its checksum
+// and is ignored.
+class CheckpointLog {
+private:
+    FILE* file = nullptr;
+    
+public:
+    ~CheckpointLog() {
+        if (file) fclose(file);
+    }
+    
+    bool open(const string& path, bool append) {
+        file = fopen(path.c_str(), append ? "ab" : "wb");
+        return file != nullptr;
+    }
+    
+    bool commit(CheckpointRecord record) {
+        memcpy(record.magic, kCheckpointMagic, sizeof(kCheckpointMagic));
+        record.checksum = record.computeChecksum();
+        return fwrite(&record, sizeof(record), 1, file) == 1 &&
+               fflush(file) == 0 && fsync(fileno(file)) == 0;
+    }
+    
+    static bool loadLast(const string& path, CheckpointRecord& last) {
+        FILE* in = fopen(path.c_str(), "rb");
+        if (!in) return false;
+        
+        bool found = false;
+        CheckpointRecord record;
+        while (fread(&record, sizeof(record), 1, in) == 1) {
+            if (memcmp(record.magic, kCheckpointMagic, sizeof(kCheckpointMagic)) == 0 &&
+                record.checksum == record.computeChecksum()) {
+                last = record;
+                found = true;
+            }
+        }
+        fclose(in);
+        return found;
+    }
+};
+
+uint64_t fileSize(const string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+// Rebuilds aggregates, statistics and the index for rows committed before
+// a restart. Rows are re-read from the input (keywords are not stored) and
+// joined with their stored results by row id; Stage 1 classification and
+// Stage 2 reports are not rerun. Leaves `reader` just past the committed
+// rows. Returns false if the input no longer lines up with the store.
+// The dedup flag is not stored either, so replayed rows count as unique.
+bool replayCommitted(CSVReader& reader, const string& store_file, 
+                     const CheckpointRecord& checkpoint,
+                     PipelineContext& ctx, StatsAccumulator& acc) {
+    ResultStoreReader store;
+    if (!store.open(store_file)) return false;
+    const vector<string>& label_names = store.labelNames();
+    
+    ThreadAggregates& agg = ctx.aggregates[0];
+    RowArena arena;
+    ResultBlock block;
+    vector<LogEntry> logs;
+    uint64_t first_row = 0;
+    uint64_t rows = 0;
+    
+    while (rows < checkpoint.rows && store.next(block, first_row)) {
+        logs.clear();
+        for (size_t r = 0; r < block.size(); r++) {
+            LogEntry log;
+            if (!reader.next(log) || log.line_id != block.line_id[r]) return false;
+            
+            log.predicted_label = block.predicted_label.at(r);
+            log.predicted_label_id = (uint8_t)(find(label_names.begin(), label_names.end(),
+                                                    log.predicted_label) - label_names.begin());
+            log.confidence = block.confidence.at(r);
+            log.severity_level = block.severity_level.at(r);
+            log.severity_id = (uint8_t)(find(begin(kSeverityNames), end(kSeverityNames),
+                                             log.severity_level) - begin(kSeverityNames));
+            log.affected_component = log.component;
+            log.stage1_time_ms = block.stage1_time_ms[r];
+            log.stage2_time_ms = block.stage2_time_ms[r];
+            log.total_time_ms = log.stage1_time_ms + log.stage2_time_ms;
+            
+            KeywordList keywords = ctx.rule_engine.extractKeywords(log.content, arena);
+            log.fast_path = ctx.rule_engine.isQuietInfo(
+                ctx.rule_engine.matchKeywords(keywords, arena.resource()), log.level);
+            log.keywords.assign(keywords.begin(), keywords.end());
+            arena.reset();
+            
+            agg.observe(log);
+            if (ctx.bursts) ctx.bursts->observe(log);
+            if (ctx.index) ctx.index->add(0, (uint32_t)(first_row + r), log);
+            logs.push_back(move(log));
+        }
+        if (ctx.index) ctx.index->flushSegment(logs);
+        acc.add(logs);
+        rows += block.size();
+    }
+    return rows == checkpoint.rows && reader.offset() == checkpoint.input_offset;
+}
+
+// ============================================================================
+// Thread Count Detection
+// ============================================================================
+
+// CPUs this process may actually use. Each limit is 0 when it does not
+// apply; threads() takes the tightest one.
+struct CpuBudget {
+    int affinity_cpus = 0;     // sched_getaffinity mask
+    int physical_cores = 0;    // distinct cores in the mask (SMT siblings merged)
+    int cgroup_cpus = 0;       // cgroup v2 cpu.max / v1 CFS quota, rounded up
+    int slurm_cpus = 0;        // SLURM_CPUS_PER_TASK
+    int omp_threads = 0;       // OMP_NUM_THREADS, taken as an explicit request
+    
+    // One thread per physical core unless `use_smt`; hyperthreads mostly
+    // compete for the same caches in this workload
+    int threads(bool use_smt) const {
+        if (omp_threads > 0) return omp_threads;
+        int n = affinity_cpus > 0 ? affinity_cpus : (int)thread::hardware_concurrency();
+        if (!use_smt && physical_cores > 0) n = min(n, physical_cores);
+        if (cgroup_cpus > 0) n = min(n, cgroup_cpus);
+        if (slurm_cpus > 0) n = min(n, slurm_cpus);
+        return max(n, 1);
+    }
+    
+    string describe() const {
+        if (omp_threads > 0) return "OMP_NUM_THREADS=" + to_string(omp_threads);
+        string out = to_string(affinity_cpus) + " CPUs in affinity mask";
+        if (physical_cores > 0 && physical_cores < affinity_cpus) {
+            out += ", " + to_string(physical_cores) + " physical cores";
+        }
+        if (cgroup_cpus > 0) out += ", cgroup quota " + to_string(cgroup_cpus);
+        if (slurm_cpus > 0) out += ", SLURM_CPUS_PER_TASK=" + to_string(slurm_cpus);
+        return out;
+    }
+};
+
+static string readFirstLine(const string& path) {
+    ifstream in(path);
+    string line;
+    getline(in, line);
+    return line;
+}
+
+static int positiveEnv(const char* name) {
+    const char* value = getenv(name);
+    int n = 0;
+    if (value) from_chars(value, value + strlen(value), n);
+    return max(n, 0);
+}
+
+// CPU quota of this process's cgroup, rounded up to whole CPUs (0 = none).
+// Container runtimes and systemd slices often set the quota on a parent,
+// so every ancestor up to the hierarchy root is checked and the tightest
+// quota wins.
+static int cgroupCpuLimit() {
+    auto quota = [](double q, double period) {
+        return q > 0 && period > 0 ? (int)ceil(q / period) : 0;
+    };
+    auto tighter = [](int a, int b) { return a == 0 ? b : b == 0 ? a : min(a, b); };
+    
+    // `root + path` and each parent up to `root`; only `root` when the
+    // path is not visible here (cgroup namespaces)
+    auto ancestors = [](const string& root, string path) {
+        vector<string> dirs;
+        struct stat st;
+        if (stat((root + path).c_str(), &st) != 0) path.clear();
+        while (!path.empty() && path != "/") {
+            dirs.push_back(root + path);
+            path.erase(path.rfind('/'));
+        }
+        dirs.push_back(root);
+        return dirs;
+    };
+    
+    // "0::<path>" for v2, "<id>:<controllers>:<path>" per v1 hierarchy
+    string v2_path, v1_path;
+    ifstream self("/proc/self/cgroup");
+    for (string line; getline(self, line);) {
+        size_t first = line.find(':');
+        size_t second = first == string::npos ? first : line.find(':', first + 1);
+        if (second == string::npos) continue;
+        string controllers = "," + line.substr(first + 1, second - first - 1) + ",";
+        if (line.compare(0, 3, "0::") == 0) v2_path = line.substr(3);
+        else if (controllers.find(",cpu,") != string::npos) v1_path = line.substr(second + 1);
+    }
+    
+    // cgroup v2: "<quota> <period>" or "max <period>" in the unified hierarchy
+    int limit = 0;
+    bool unified = false;
+    for (const string& dir : ancestors("/sys/fs/cgroup", v2_path)) {
+        string max_line = readFirstLine(dir + "/cpu.max");
+        if (max_line.empty()) continue;
+        unified = true;
+        double q = 0, period = 0;
+        if (sscanf(max_line.c_str(), "%lf %lf", &q, &period) == 2) {
+            limit = tighter(limit, quota(q, period));
+        }
+    }
+    if (unified) return limit;
+    
+    // cgroup v1: CFS quota and period (quota -1 = unlimited)
+    for (const char* mount : {"/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct"}) {
+        for (const string& dir : ancestors(mount, v1_path)) {
+            string q = readFirstLine(dir + "/cpu.cfs_quota_us");
+            string period = readFirstLine(dir + "/cpu.cfs_period_us");
+            if (!q.empty() && !period.empty()) {
+                limit = tighter(limit, quota(atof(q.c_str()), atof(period.c_str())));
+            }
+        }
+    }
+    return limit;
+}
+
+CpuBudget detectCpuBudget() {
+    CpuBudget budget;
+    
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        budget.affinity_cpus = CPU_COUNT(&mask);
+        
+        // Hyperthreads of one core share a thread_siblings_list
+        set<string> cores;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &mask)) continue;
+            string siblings = readFirstLine("/sys/devices/system/cpu/cpu" + to_string(cpu) + 
+                                            "/topology/thread_siblings_list");
+            if (siblings.empty()) {
+                cores.clear();
+                break;
+            }
+            cores.insert(siblings);
+        }
+        budget.physical_cores = (int)cores.size();
+    }
+    
+    budget.cgroup_cpus = cgroupCpuLimit();
+    budget.slurm_cpus = positiveEnv("SLURM_CPUS_PER_TASK");
+    budget.omp_threads = positiveEnv("OMP_NUM_THREADS");
+    return budget;
+}
+
+// ============================================================================
+// Command-Line Options
+// ============================================================================
+
+struct RunOptions {
+    string input_file = "data/subset_500.csv";
+    string output_dir = "output/";
+    int num_threads = 0;           // 0 = detect from the CPU budget
+    string thread_source = "command line";   // how num_threads was chosen
+    bool use_smt = false;          // auto: count hyperthreads, not just cores
+    bool calibrate = false;        // time a sample at several thread counts
+    long memory_limit_mb = 0;      // 0 = keep all rows in memory
+    int top_k = 10;                // heavy hitters to report (0 = off)
+    bool distinct_counts = true;   // HyperLogLog cardinality estimates
+    bool topology = true;          // rack/midplane/node card rollups
+    long cube_bucket_sec = 0;      // aggregate cube time bucket (0 = off)
+    long burst_window_sec = 0;     // burst detection window (0 = off)
+    long burst_min_count = 10;     // minimum rows in a window to alert
+    bool build_index = false;      // keyword/EventId inverted index
+    bool store = false;            // keep the columnar result store
+    bool checkpoint = false;       // commit segments to the store + checkpoint log
+    bool resume = false;           // continue from the last checkpoint
+    int udp_port = 0;              // listen: syslog over UDP (0 = off)
+    int tcp_port = 0;              // listen: syslog over TCP (0 = off)
+    long duration_sec = 0;         // listen: stop after this long (0 = until signalled)
+    int metrics_port = 0;          // serve/listen: localhost /metrics endpoint (0 = off)
+    string shed_policy = "block";  // listen: block|drop-info|sample|template-cache
+    double shed_at = 0.5;          // listen: queue occupancy that engages shedding
+    int sample_every = 10;         // listen: keep 1 in N INFO rows when sampling
+    bool dedup = false;            // analyze each distinct Content + Level once per segment
+    string rule_engine = kDefaultRuleEngine;   // see ruleEngineVariants()
+};
+
+// Columns the enabled stages and outputs actually read
+ColumnMask requiredColumns(const RunOptions& opts) {
+    // Results: LineId, GroundTruth (also used for accuracy)
+    ColumnMask columns = columnBit(COL_LINE_ID) | columnBit(COL_LABEL);
+    
+    // Stage 1: keywords/classification, severity, affected component
+    columns |= columnBit(COL_CONTENT) | columnBit(COL_LEVEL) | columnBit(COL_COMPONENT);
+    
+    // Heavy hitters and distinct counts: nodes and templates
+    if (opts.top_k > 0 || opts.distinct_counts) {
+        columns |= columnBit(COL_NODE) | columnBit(COL_EVENT_ID);
+    }
+    
+    // Topology rollups: decoded node locations
+    if (opts.topology) {
+        columns |= columnBit(COL_NODE);
+    }
+    
+    // Aggregate cube: time x label x severity x rack
+    if (opts.cube_bucket_sec > 0) {
+        columns |= columnBit(COL_TIMESTAMP) | columnBit(COL_NODE);
+    }
+    
+    // Inverted index row table and result store: time, location, template
+    if (opts.build_index || opts.store) {
+        columns |= columnBit(COL_EVENT_ID) | columnBit(COL_TIMESTAMP) | columnBit(COL_NODE);
+    }
+    
+    // Burst detection: time windows per node and template
+    if (opts.burst_window_sec > 0) {
+        columns |= columnBit(COL_TIMESTAMP) | columnBit(COL_NODE) | columnBit(COL_EVENT_ID);
+    }
+    
+    return columns;
+}
+
+void printUsage(const char* prog) {
+    cerr << "Usage: " << prog << " <input.csv> <output_dir> [num_threads|auto] [options]" << endl;
+    cerr << "Options:" << endl;
+    cerr << "  --smt                 auto threads: use every hyperthread, not one per core" << endl;
+    cerr << "  --calibrate           Time a sample at several thread counts and keep the fastest" << endl;
+    cerr << "  --memory-limit <MB>   Process in segments and spill results to disk" << endl;
+    cerr << "  --top-k <K>           Heavy hitters to report per dimension (0 = off, default 10)" << endl;
+    cerr << "  --no-distinct         Skip HyperLogLog distinct counts" << endl;
+    cerr << "  --no-topology         Skip rack/midplane/node card rollups" << endl;
+    cerr << "  --cube <minute|hour|sec>  Write time x label x severity x rack counts" << endl;
+    cerr << "  --index               Build a keyword/EventId index for '" << prog << " query'" << endl;
+    cerr << "  --store               Keep a columnar result store for '" << prog << " query'" << endl;
+    cerr << "  --engine <name>       Stage 1 tokenizer-matcher-scorer (default " << kDefaultRuleEngine << "):" << endl;
+    for (const auto& variant : ruleEngineVariants()) {
+        cerr << "                          " << variant.name << (variant.exact ? "" : " (not reference-exact)") << endl;
+    }
+    cerr << "  --dedup               Analyze identical Content + Level once per segment" << endl;
+    cerr << "  --checkpoint          Commit results in segments so a killed run can resume" << endl;
+    cerr << "  --resume              Continue from the last checkpoint in <output_dir>" << endl;
+    cerr << "  --burst-window <sec>  Detect per-node/template bursts in windows of <sec>" << endl;
+    cerr << "  --burst-min <N>       Minimum problem rows in a window to alert (default 10)" << endl;
+    cerr << "  --metrics-port <P>    serve/listen: expose Prometheus metrics on localhost:<P>/metrics" << endl;
+    cerr << "  --shed <policy>       listen: block|drop-info|sample|template-cache when behind (default block)" << endl;
+    cerr << "  --shed-at <PCT>       listen: queue occupancy that engages shedding (default 50)" << endl;
+    cerr << "  --sample-every <N>    listen: keep 1 in N INFO rows under the sample policy (default 10)" << endl;
+    cerr << "Subcommands:" << endl;
+    cerr << "  " << prog << " query <output_dir> [field=value ...] [group by <field>] [top N] [count]" << endl;
+    cerr << "  " << prog << " serve <socket> <output_dir> <num_threads> [options]" << endl;
+    cerr << "  " << prog << " client <socket> <input.csv> [--batch N] | stats | reset | shutdown" << endl;
+    cerr << "  " << prog << " listen <bind_addr> <output_dir> <num_threads> [--udp P] [--tcp P] [--duration S] [options]" << endl;
+    cerr << "  " << prog << " loggen <udp|tcp> <host> <port> <input.csv> [--rate N]" << endl;
+}
+
+bool parseArgs(int argc, char* argv[], RunOptions& opts) {
+    // Reads the value of option argv[i] into `value`; false if malformed
+    auto number = [&](int& i, auto& value) {
+        string option = argv[i];
+        string text = argv[++i];
+        if (parseNumber(text, value)) return true;
+        cerr << "Error: Invalid value '" << text << "' for " << option << endl;
+        return false;
+    };
+    
+    vector<string> positional;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--memory-limit" && i + 1 < argc) {
+            if (!number(i, opts.memory_limit_mb)) return false;
+        } else if (arg == "--top-k" && i + 1 < argc) {
+            if (!number(i, opts.top_k)) return false;
+        } else if (arg == "--no-distinct") {
+            opts.distinct_counts = false;
+        } else if (arg == "--no-topology") {
+            opts.topology = false;
+        } else if (arg == "--cube" && i + 1 < argc) {
+            string bucket = argv[i + 1];
+            if (bucket == "minute" || bucket == "hour") {
+                opts.cube_bucket_sec = bucket == "minute" ? 60 : 3600;
+                i++;
+            } else if (!number(i, opts.cube_bucket_sec)) {
+                return false;
+            }
+        } else if (arg == "--index") {
+            opts.build_index = true;
+        } else if (arg == "--store") {
+            opts.store = true;
+        } else if (arg == "--engine" && i + 1 < argc) {
+            opts.rule_engine = argv[++i];
+            if (!makeRuleEngine(opts.rule_engine)) {
+                cerr << "Error: Unknown rule engine " << opts.rule_engine << endl;
+                return false;
+            }
+        } else if (arg == "--smt") {
+            opts.use_smt = true;
+        } else if (arg == "--calibrate") {
+            opts.calibrate = true;
+        } else if (arg == "--dedup") {
+            opts.dedup = true;
+        } else if (arg == "--checkpoint") {
+            opts.checkpoint = true;
+        } else if (arg == "--resume") {
+            opts.checkpoint = true;
+            opts.resume = true;
+        } else if (arg == "--udp" && i + 1 < argc) {
+            if (!number(i, opts.udp_port)) return false;
+        } else if (arg == "--tcp" && i + 1 < argc) {
+            if (!number(i, opts.tcp_port)) return false;
+        } else if (arg == "--shed" && i + 1 < argc) {
+            opts.shed_policy = argv[++i];
+        } else if (arg == "--shed-at" && i + 1 < argc) {
+            if (!number(i, opts.shed_at)) return false;
+            opts.shed_at /= 100.0;
+        } else if (arg == "--sample-every" && i + 1 < argc) {
+            if (!number(i, opts.sample_every)) return false;
+            opts.sample_every = max(1, opts.sample_every);
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            if (!number(i, opts.metrics_port)) return false;
+        } else if (arg == "--duration" && i + 1 < argc) {
+            if (!number(i, opts.duration_sec)) return false;
+        } else if (arg == "--burst-window" && i + 1 < argc) {
+            if (!number(i, opts.burst_window_sec)) return false;
+        } else if (arg == "--burst-min" && i + 1 < argc) {
+            if (!number(i, opts.burst_min_count)) return false;
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            cerr << "Error: Unknown option " << arg << endl;
+            return false;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    
+    if (positional.size() > 0) opts.input_file = positional[0];
+    if (positional.size() > 1) opts.output_dir = positional[1];
+    if (positional.size() > 2 && positional[2] != "auto" && 
+        !parseNumber(positional[2], opts.num_threads)) {
+        cerr << "Error: Invalid thread count '" << positional[2] << "'" << endl;
+        return false;
+    }
+    
+    // Ensure output directory ends with /
+    if (!opts.output_dir.empty() && opts.output_dir.back() != '/') {
+        opts.output_dir += '/';
+    }
+    
+    // Checkpoints point into the result store, so it must be kept
+    if (opts.checkpoint) opts.store = true;
+    
+    if (opts.num_threads <= 0) {
+        CpuBudget budget = detectCpuBudget();
+        opts.num_threads = budget.threads(opts.use_smt);
+        opts.thread_source = "auto: " + budget.describe();
+    }
+    return true;
+}
+
+// ============================================================================
+// Query Subcommand
+// ============================================================================
+
+// Query language: filters, then an optional aggregation, e.g.
+//   keyword=parity rack=R36 from=1131000000 to=1131090000
+//   severity=FATAL group by node top 20
+//   label=Network count
+// Filters are ANDed. Keyword filters use the inverted index; everything
+// else is evaluated on the result store when present, or on the index row
+// table otherwise.
+struct QuerySpec {
+    vector<pair<char, string>> terms;   // keyword / EventId postings
+    vector<pair<string, string>> columns;   // store column = value
+    string node;
+    int rack = -1;
+    int64_t from = INT64_MIN;
+    int64_t to = INT64_MAX;
+    string group_by;
+    bool count_only = false;
+    size_t limit = 20;
+    
+    bool hasTimeRange() const { return from != INT64_MIN || to != INT64_MAX; }
+};
+
+static const char* const kGroupFields[] = {
+    "node", "rack", "event", "label", "truth", "severity", "confidence",
+    "component", "minute", "hour", "day"
+};
+
+// Maps raw log levels onto the stored severity names
+string normalizeSeverity(const string& value) {
+    if (value == "FATAL" || value == "CRITICAL") return "CRITICAL";
+    if (value == "WARN" || value == "WARNING") return "WARNING";
+    return value;
+}
+
+bool parseQuery(const vector<string>& tokens, QuerySpec& q) {
+    for (size_t i = 0; i < tokens.size(); i++) {
+        const string& tok = tokens[i];
+        if ((tok == "limit" || tok == "top") && i + 1 < tokens.size()) {
+            if (!parseNumber(tokens[++i], q.limit)) {
+                cerr << "Error: Invalid " << tok << " '" << tokens[i] << "'" << endl;
+                return false;
+            }
+            continue;
+        }
+        if (tok == "count") {
+            q.count_only = true;
+            continue;
+        }
+        if (tok == "group" && i + 2 < tokens.size() && tokens[i + 1] == "by") {
+            q.group_by = tokens[i + 2];
+            i += 2;
+            if (find(begin(kGroupFields), end(kGroupFields), q.group_by) == end(kGroupFields)) {
+                cerr << "Error: Cannot group by '" << q.group_by << "'" << endl;
+                return false;
+            }
+            continue;
+        }
+        
+        size_t eq = tok.find('=');
+        if (eq == string::npos) {
+            cerr << "Error: Expected field=value, got '" << tok << "'" << endl;
+            return false;
+        }
+        string field = tok.substr(0, eq);
+        string value = tok.substr(eq + 1);
+        
+        if (field == "keyword" || field == "kw") {
+            // Keywords are indexed lowercase and alphanumeric only
+            string term;
+            for (char c : value) {
+                if (isAlnumChar(c)) term += lowerChar(c);
+            }
+            q.terms.push_back({TERM_KEYWORD, term});
+        } else if (field == "event" || field == "template") {
+            q.columns.push_back({"event", value});
+        } else if (field == "node") {
+            q.node = value;
+        } else if (field == "rack") {
+            uint16_t topo = decodeNode((value + "-M0").c_str(), value.size() + 3);
+            if (!(topo & TOPO_VALID)) {
+                cerr << "Error: Invalid rack '" << value << "'" << endl;
+                return false;
+            }
+            q.rack = topoRack(topo);
+        } else if (field == "from" || field == "to" || field == "limit") {
+            bool ok = field == "from" ? parseNumber(value, q.from) :
+                      field == "to" ? parseNumber(value, q.to) : parseNumber(value, q.limit);
+            if (!ok) {
+                cerr << "Error: Invalid " << field << " '" << value << "'" << endl;
+                return false;
+            }
+        } else if (field == "severity") {
+            q.columns.push_back({"severity", normalizeSeverity(value)});
+        } else if (field == "label" || field == "truth" || 
+                   field == "confidence" || field == "component") {
+            q.columns.push_back({field, value});
+        } else {
+            cerr << "Error: Unknown query field '" << field << "'" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Row ids matching all terms, intersecting from the shortest list up
+vector<uint32_t> intersectPostings(const InvertedIndex& idx, 
+                                   const vector<pair<char, string>>& terms) {
+    vector<const PostingList*> lists;
+    for (const auto& [kind, term] : terms) {
+        const PostingList* list = idx.find(kind, term);
+        if (!list) return {};
+        lists.push_back(list);
+    }
+    sort(lists.begin(), lists.end(), [](const PostingList* a, const PostingList* b) {
+        return a->count < b->count;
+    });
+    
+    vector<uint32_t> result = lists[0]->decode();
+    for (size_t l = 1; l < lists.size() && !result.empty(); l++) {
+        vector<uint32_t> next = lists[l]->decode();
+        vector<uint32_t> both;
+        set_intersection(result.begin(), result.end(), next.begin(), next.end(),
+                         back_inserter(both));
+        result.swap(both);
+    }
+    return result;
+}
+
+const DictColumn* storeColumn(const ResultBlock& block, const string& field) {
+    if (field == "node") return &block.node;
+    if (field == "event") return &block.event_id;
+    if (field == "label") return &block.predicted_label;
+    if (field == "truth") return &block.label;
+    if (field == "severity") return &block.severity_level;
+    if (field == "confidence") return &block.confidence;
+    if (field == "component") return &block.component;
+    return nullptr;
+}
+
+struct QueryOutput {
+    uint64_t matched = 0;
+    uint64_t scanned_blocks = 0;
+    uint64_t skipped_blocks = 0;
+    unordered_map<string, uint64_t> groups;
+    vector<string> rows;           // formatted, in store order
+};
+
+// Evaluates the query on one block: filters become a selection vector one
+// column at a time (tight loops over codes), then the selection is counted,
+// grouped or listed.
+void scanBlock(const ResultBlock& block, uint64_t first_row, const QuerySpec& q,
+               const vector<uint32_t>* candidates, QueryOutput& out) {
+    size_t n = block.size();
+    vector<uint8_t> sel(n, 1);
+    
+    if (candidates) {
+        fill(sel.begin(), sel.end(), 0);
+        auto it = lower_bound(candidates->begin(), candidates->end(), (uint32_t)first_row);
+        for (; it != candidates->end() && *it < first_row + n; ++it) {
+            sel[*it - first_row] = 1;
+        }
+    }
+    
+    for (const auto& [field, value] : q.columns) {
+        const DictColumn* col = storeColumn(block, field);
+        int code = col->lookup(value);
+        if (code < 0) return;
+        const uint16_t* codes = col->codes.data();
+        for (size_t r = 0; r < n; r++) sel[r] &= (codes[r] == code);
+    }
+    if (!q.node.empty()) {
+        int code = block.node.lookup(q.node);
+        if (code < 0) return;
+        const uint16_t* codes = block.node.codes.data();
+        for (size_t r = 0; r < n; r++) sel[r] &= (codes[r] == code);
+    }
+    if (q.hasTimeRange()) {
+        const int64_t* t = block.unix_time.data();
+        for (size_t r = 0; r < n; r++) sel[r] &= (t[r] >= q.from) & (t[r] <= q.to);
+    }
+    if (q.rack >= 0) {
+        const uint16_t* topo = block.topology.data();
+        for (size_t r = 0; r < n; r++) {
+            sel[r] &= ((topo[r] & TOPO_VALID) != 0) & (topoRack(topo[r]) == q.rack);
+        }
+    }
+    
+    uint64_t matched = 0;
+    for (size_t r = 0; r < n; r++) matched += sel[r];
+    out.matched += matched;
+    if (matched == 0 || q.count_only) return;
+    
+    if (!q.group_by.empty()) {
+        const DictColumn* col = storeColumn(block, q.group_by);
+        if (col) {
+            // Count per dictionary code, then translate once per block
+            vector<uint64_t> per_code(col->dict.size(), 0);
+            for (size_t r = 0; r < n; r++) per_code[col->codes[r]] += sel[r];
+            for (size_t c = 0; c < per_code.size(); c++) {
+                if (per_code[c]) out.groups[col->dict[c]] += per_code[c];
+            }
+        } else if (q.group_by == "rack") {
+            vector<uint64_t> per_rack(TOPO_RACKS + 1, 0);
+            for (size_t r = 0; r < n; r++) {
+                uint16_t topo = block.topology[r];
+                per_rack[(topo & TOPO_VALID) ? topoRack(topo) : TOPO_RACKS] += sel[r];
+            }
+            for (int rack = 0; rack <= TOPO_RACKS; rack++) {
+                if (!per_rack[rack]) continue;
+                out.groups[rack == TOPO_RACKS ? "-" 
+                           : TopologyRollup::locationName(TopologyRollup::RACK, rack)] += per_rack[rack];
+            }
+        } else {
+            int64_t bucket = q.group_by == "minute" ? 60 : q.group_by == "hour" ? 3600 : 86400;
+            for (size_t r = 0; r < n; r++) {
+                if (sel[r]) out.groups[to_string(block.unix_time[r] / bucket * bucket)]++;
+            }
+        }
+        return;
+    }
+    
+    for (size_t r = 0; r < n && out.rows.size() < q.limit; r++) {
+        if (!sel[r]) continue;
+        ostringstream row;
+        row << block.line_id[r] << "," << block.unix_time[r] << ","
+            << block.node.at(r) << "," << block.event_id.at(r) << ","
+            << block.severity_level.at(r) << "," << block.predicted_label.at(r) << ","
+            << block.confidence.at(r) << "," << block.label.at(r);
+        out.rows.push_back(row.str());
+    }
+}
+
+// Zone-map check: false only if no row of the block can satisfy the
+// filters. Bloom filters may report false positives, never negatives.
+bool blockMayMatch(const BlockSummary& summary, uint64_t first_row, const QuerySpec& q,
+                   const vector<string>& label_names, const vector<uint32_t>* candidates) {
+    if (q.hasTimeRange() && !summary.overlaps(q.from, q.to)) return false;
+    if (!q.node.empty() && !summary.nodes.mayContain(hashKey(q.node))) return false;
+    
+    for (const auto& [field, value] : q.columns) {
+        if (field == "severity") {
+            auto it = find(begin(kSeverityNames), end(kSeverityNames), value);
+            if (it == end(kSeverityNames)) return false;
+            if (!(summary.severities & (1u << (it - begin(kSeverityNames))))) return false;
+        } else if (field == "label") {
+            auto it = find(label_names.begin(), label_names.end(), value);
+            if (it == label_names.end()) return false;
+            if (!(summary.labels & (1ULL << ((it - label_names.begin()) & 63)))) return false;
+        }
+    }
+    for (const auto& [kind, term] : q.terms) {
+        if (kind == TERM_KEYWORD && !summary.keywords.mayContain(hashKey(term))) return false;
+    }
+    if (candidates) {
+        auto it = lower_bound(candidates->begin(), candidates->end(), (uint32_t)first_row);
+        if (it == candidates->end() || *it >= first_row + summary.rows) return false;
+    }
+    return true;
+}
+
+// Streams the store in batches of blocks; blocks of a batch are scanned in
+// parallel with per-thread outputs merged in block order. Blocks whose
+// summary rules out a match are skipped without being decoded.
+QueryOutput scanStore(ResultStoreReader& reader, const QuerySpec& q,
+                      const vector<uint32_t>* candidates) {
+    QueryOutput total;
+    int threads = omp_get_max_threads();
+    size_t batch_size = max(1, 2 * threads);
+    
+    vector<ResultBlock> batch(batch_size);
+    vector<uint64_t> first_rows(batch_size);
+    BlockSummary summary;
+    bool more = true;
+    while (more) {
+        size_t loaded = 0;
+        while (loaded < batch_size) {
+            if (!reader.nextSummary(summary)) {
+                more = false;
+                break;
+            }
+            if (!blockMayMatch(summary, reader.blockStart(), q, reader.labelNames(), candidates)) {
+                reader.skipBlock();
+                total.skipped_blocks++;
+                continue;
+            }
+            if (!reader.readBlock(batch[loaded])) {
+                more = false;
+                break;
+            }
+            first_rows[loaded++] = reader.blockStart();
+        }
+        if (loaded == 0) break;
+        
+        vector<QueryOutput> outputs(loaded);
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t b = 0; b < loaded; b++) {
+            scanBlock(batch[b], first_rows[b], q, candidates, outputs[b]);
+        }
+        
+        for (auto& o : outputs) {
+            total.matched += o.matched;
+            for (auto& [key, count] : o.groups) total.groups[key] += count;
+            for (auto& row : o.rows) {
+                if (total.rows.size() < q.limit) total.rows.push_back(move(row));
+            }
+        }
+        total.scanned_blocks += loaded;
+    }
+    return total;
+}
+
+// Index-only fallback when no result store was written
+QueryOutput scanIndex(const InvertedIndex& idx, const QuerySpec& q,
+                      const vector<uint32_t>* candidates) {
+    QueryOutput out;
+    int64_t node_code = -1;
+    if (!q.node.empty()) {
+        auto it = find(idx.node_names.begin(), idx.node_names.end(), q.node);
+        if (it == idx.node_names.end()) return out;
+        node_code = it - idx.node_names.begin();
+    }
+    
+    size_t n = candidates ? candidates->size() : idx.rows();
+    for (size_t i = 0; i < n; i++) {
+        uint32_t r = candidates ? (*candidates)[i] : (uint32_t)i;
+        int64_t t = idx.unix_times[r];
+        if (q.hasTimeRange() && (t < q.from || t > q.to)) continue;
+        if (node_code >= 0 && idx.node_codes[r] != (uint32_t)node_code) continue;
+        if (q.rack >= 0) {
+            uint16_t topo = idx.topologies[r];
+            if (!(topo & TOPO_VALID) || topoRack(topo) != q.rack) continue;
+        }
+        out.matched++;
+        if (q.group_by == "node") {
+            out.groups[idx.node_names[idx.node_codes[r]]]++;
+        } else if (!q.count_only && out.rows.size() < q.limit) {
+            out.rows.push_back(to_string(idx.line_ids[r]) + "," + to_string(t) + "," +
+                               idx.node_names[idx.node_codes[r]]);
+        }
+    }
+    return out;
+}
+
+int runQuery(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: scenario_d query <output_dir> [field=value ...] "
+             << "[group by <field>] [top N | limit N] [count]" << endl;
+        cerr << "Filters: keyword, event, node, rack, from, to, severity, label, "
+             << "truth, confidence, component" << endl;
+        cerr << "Group by: node, rack, event, label, truth, severity, confidence, "
+             << "component, minute, hour, day" << endl;
+        return 1;
+    }
+    
+    string dir = argv[1];
+    if (!dir.empty() && dir.back() != '/') dir += '/';
+    
+    QuerySpec q;
+    if (!parseQuery(vector<string>(argv + 2, argv + argc), q)) return 1;
+    
+    auto start = chrono::high_resolution_clock::now();
+    
+    ResultStoreReader store;
+    bool has_store = store.open(dir + "scenario_d_results.col");
+    
+    // Without a store, EventId filters go through the index postings
+    if (!has_store) {
+        for (auto it = q.columns.begin(); it != q.columns.end();) {
+            if (it->first == "event") {
+                q.terms.push_back({TERM_EVENT, it->second});
+                it = q.columns.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    // Store-only fields cannot be answered from the index row table
+    if (!has_store && (!q.columns.empty() || (!q.group_by.empty() && q.group_by != "node"))) {
+        cerr << "Error: Query needs " << dir << "scenario_d_results.col (run with --store)" << endl;
+        return 1;
+    }
+    
+    InvertedIndex idx;
+    bool need_index = !q.terms.empty() || !has_store;
+    if (need_index && !idx.load(dir + "scenario_d_index.bin")) {
+        cerr << "Error: Cannot read " << dir << "scenario_d_index.bin (run with --index)" << endl;
+        return 1;
+    }
+    
+    vector<uint32_t> candidates;
+    if (!q.terms.empty()) candidates = intersectPostings(idx, q.terms);
+    const vector<uint32_t>* cand = q.terms.empty() ? nullptr : &candidates;
+    
+    QueryOutput out = has_store ? scanStore(store, q, cand) : scanIndex(idx, q, cand);
+    auto end = chrono::high_resolution_clock::now();
+    
+    if (q.count_only) {
+        cout << "count" << endl << out.matched << endl;
+    } else if (!q.group_by.empty()) {
+        vector<pair<string, uint64_t>> groups(out.groups.begin(), out.groups.end());
+        sort(groups.begin(), groups.end(), [](const pair<string, uint64_t>& a,
+                                              const pair<string, uint64_t>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        cout << q.group_by << ",count" << endl;
+        for (size_t i = 0; i < min(q.limit, groups.size()); i++) {
+            cout << groups[i].first << "," << groups[i].second << endl;
+        }
+    } else {
+        cout << (has_store ? "LineId,Timestamp,Node,EventId,Severity,PredictedLabel,Confidence,GroundTruth"
+                           : "LineId,Timestamp,Node") << endl;
+        for (const auto& row : out.rows) cout << row << endl;
+    }
+    
+    double ms = chrono::duration<double, milli>(end - start).count();
+    cerr << out.matched << " matching rows";
+    if (has_store) {
+        cerr << ", " << out.scanned_blocks << " blocks scanned, " 
+             << out.skipped_blocks << " skipped";
+    }
+    cerr << " (" << fixed << setprecision(2) << ms << " ms)" << endl;
+    return 0;
+}
+
+// ============================================================================
+// Daemon Mode
+// ============================================================================
+
+// Framing for the Unix socket protocol. Every request and response is a
+// text line "<WORD> <payload bytes>" followed by the payload:
+//   BATCH     CSV header + rows -> OK with their result rows
+//   STATS     -> OK with the performance JSON for all rows so far
+//   RESET     clear statistics and aggregates -> OK
+//   SHUTDOWN  save outputs and stop the daemon -> OK
+// Failures come back as ERR with a message payload.
+class FrameChannel {
+private:
+    int fd;
+    string buffer;
+    size_t pos = 0;
+    
+    bool fill() {
+        if (pos > 0) {
+            buffer.erase(0, pos);
+            pos = 0;
+        }
+        char chunk[65536];
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+        return true;
+    }
+    
+public:
+    explicit FrameChannel(int socket_fd) : fd(socket_fd) {}
+    
+    bool readFrame(string& word, string& payload) {
+        size_t newline;
+        while ((newline = buffer.find('\n', pos)) == string::npos) {
+            if (!fill()) return false;
+        }
+        istringstream header(buffer.substr(pos, newline - pos));
+        size_t bytes = 0;
+        if (!(header >> word >> bytes)) return false;
+        pos = newline + 1;
+        
+        while (buffer.size() - pos < bytes) {
+            if (!fill()) return false;
+        }
+        payload.assign(buffer, pos, bytes);
+        pos += bytes;
+        return true;
+    }
+    
+    bool writeFrame(const string& word, const string& payload) {
+        string frame = word + " " + to_string(payload.size()) + "\n" + payload;
+        const char* p = frame.data();
+        size_t left = frame.size();
+        while (left > 0) {
+            ssize_t n = write(fd, p, left);
+            if (n <= 0) return false;
+            p += n;
+            left -= n;
+        }
+        return true;
+    }
+};
+
+int connectUnixSocket(const string& path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path.c_str());
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Keeps the rule engine, aggregates and OpenMP team alive between batches
+// so a batch only pays for parsing and processing its own rows.
+class Daemon {
+private:
+    const RunOptions& opts;
+    bool ground_truth;   // rows carry a Label column to score against
+    unique_ptr<RuleEngine> engine;
+    RuleEngine& rule_engine;
+    ReportGenerator report_gen;
+    AggregateConfig agg_cfg;
+    vector<ThreadAggregates> aggregates;
+    unique_ptr<BurstDetector> bursts;
+    StatsAccumulator acc;
+    ParseErrorCounts parse_errors;   // batches have no quarantine file
+    ColumnMask columns;
+    size_t rows = 0;
+    atomic<size_t> batches{0};   // also read by metrics scrapes
+    double busy_time = 0;
+    unique_ptr<PipelineMetrics> live_metrics;
+    unique_ptr<MetricsServer> metrics_server;
+    
+    PipelineContext context() {
+        PipelineContext ctx{rule_engine, report_gen, aggregates, bursts.get(), nullptr};
+        ctx.progress = false;
+        ctx.metrics = live_metrics.get();
+        ctx.dedup = opts.dedup;
+        return ctx;
+    }
+    
+    void reset() {
+        aggregates.assign(opts.num_threads, ThreadAggregates(agg_cfg));
+        if (opts.burst_window_sec > 0) {
+            BurstDetector::Config cfg;
+            cfg.window_sec = opts.burst_window_sec;
+            cfg.min_count = (uint32_t)opts.burst_min_count;
+            bursts.reset(new BurstDetector(cfg));
+        }
+        acc = StatsAccumulator();
+        parse_errors = ParseErrorCounts();
+        rows = 0;
+        busy_time = 0;
+    }
+    
+    ThreadAggregates mergedAggregates() const {
+        ThreadAggregates merged = aggregates[0];
+        for (size_t t = 1; t < aggregates.size(); t++) merged.merge(aggregates[t]);
+        return merged;
+    }
+    
+    string processBatch(const string& payload) {
+        vector<LogEntry> logs;
+        CSVReader reader(payload, "batch " + to_string(batches.load()), columns);
+        readSegment(reader, logs, 0);
+        parse_errors.merge(reader.parseErrors());
+        process(logs);
+        
+        ostringstream out;
+        for (const auto& log : logs) {
+            writeResultRow(out, log.line_id, log.label, log.predicted_label,
+                           log.confidence, log.severity_level, log.stage1_time_ms,
+                           log.stage2_time_ms, log.keywords.size());
+        }
+        return out.str();
+    }
+    
+public:
+    explicit Daemon(const RunOptions& options, bool labeled_rows = true) 
+        : opts(options), ground_truth(labeled_rows), engine(makeRuleEngine(opts.rule_engine)),
+          rule_engine(*engine) {
+        agg_cfg.top_k = opts.top_k;
+        agg_cfg.distinct_counts = opts.distinct_counts;
+        agg_cfg.topology_labels = opts.topology ? rule_engine.labelNames().size() : 0;
+        agg_cfg.cube_bucket_sec = opts.cube_bucket_sec;
+        agg_cfg.cube_labels = rule_engine.labelNames().size();
+        columns = requiredColumns(opts);
+        reset();
+        
+        if (opts.metrics_port > 0) {
+            live_metrics.reset(new PipelineMetrics(opts.num_threads, rule_engine.labelNames()));
+            live_metrics->addCollector([this](ostream& out) {
+                out << "# HELP scenario_d_batches_total Batches processed.\n";
+                out << "# TYPE scenario_d_batches_total counter\n";
+                out << "scenario_d_batches_total " << batches << "\n";
+            });
+            metrics_server.reset(new MetricsServer(*live_metrics));
+            if (metrics_server->start(opts.metrics_port)) {
+                cout << "Metrics on http://127.0.0.1:" << opts.metrics_port << "/metrics" << endl;
+            } else {
+                cerr << "Warning: Cannot serve metrics on port " << opts.metrics_port 
+                     << ": " << strerror(errno) << endl;
+                metrics_server.reset();
+            }
+        }
+        
+        // Start the thread team now rather than on the first batch
+        omp_set_num_threads(opts.num_threads);
+        #pragma omp parallel
+        {
+            RowArena arena;
+        }
+    }
+    
+    // Runs the warm pipeline over already parsed rows. With a template
+    // cache, rows of known templates skip Stage 1 analysis.
+    void process(vector<LogEntry>& logs, const TemplateCache* cache = nullptr) {
+        PipelineContext ctx = context();
+        ctx.template_cache = cache;
+        busy_time += processSegment(logs, ctx, rows);
+        acc.add(logs);
+        rows += logs.size();
+        batches++;
+    }
+    
+    string statsJSON() const {
+        ThreadAggregates merged = mergedAggregates();
+        PerformanceStats stats = calculateStats(acc, busy_time, opts.num_threads);
+        stats.peak_memory_mb = peakMemoryMB();
+        stats.has_dedup = opts.dedup;
+        stats.has_ground_truth = ground_truth;
+        stats.parse_errors = parse_errors;
+        merged.fillStats(stats);
+        
+        ostringstream out;
+        writeStatsJSON(out, stats, merged);
+        return out.str();
+    }
+    
+    void saveOutputs() const {
+        ofstream(opts.output_dir + "scenario_d_performance.json") << statsJSON();
+        
+        ThreadAggregates merged = mergedAggregates();
+        if (merged.topology.enabled()) {
+            saveTopologyReport(merged.topology, rule_engine.labelNames(),
+                               opts.output_dir + "scenario_d_topology.csv");
+        }
+        if (merged.cube.enabled()) {
+            merged.cube.save(opts.output_dir + "scenario_d_cube.csv", rule_engine.labelNames());
+        }
+        if (bursts) saveBurstAlerts(bursts->finish(), opts.output_dir + "scenario_d_alerts.csv");
+    }
+    
+    // Serves one connection; returns false once SHUTDOWN was received
+    bool serve(int fd) {
+        FrameChannel channel(fd);
+        string word, payload;
+        while (channel.readFrame(word, payload)) {
+            if (word == "BATCH") {
+                channel.writeFrame("OK", processBatch(payload));
+            } else if (word == "STATS") {
+                channel.writeFrame("OK", statsJSON());
+            } else if (word == "RESET") {
+                reset();
+                channel.writeFrame("OK", "");
+            } else if (word == "SHUTDOWN") {
+                saveOutputs();
+                channel.writeFrame("OK", "");
+                return false;
+            } else {
+                channel.writeFrame("ERR", "unknown request " + word);
+            }
+        }
+        return true;
+    }
+    
+    size_t rowCount() const { return rows; }
+    size_t batchCount() const { return batches; }
+    PipelineMetrics* metrics() { return live_metrics.get(); }
+    const vector<string>& labelNames() const { return rule_engine.labelNames(); }
+};
+
+int runDaemon(int argc, char* argv[]) {
+    RunOptions opts;
+    if (!parseArgs(argc, argv, opts) || argc < 2) {
+        cerr << "Usage: scenario_d serve <socket> <output_dir> <num_threads> [options]" << endl;
+        return 1;
+    }
+    const string& socket_path = opts.input_file;
+    
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Error: Socket path too long: " << socket_path << endl;
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path.c_str());
+    
+    // Replace a stale socket from an earlier run, but never anything else
+    struct stat existing;
+    if (lstat(socket_path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            cerr << "Error: " << socket_path << " exists and is not a socket" << endl;
+            return 1;
+        }
+        unlink(socket_path.c_str());
+    }
+    
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || 
+        ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(listener, 16) != 0) {
+        cerr << "Error: Cannot listen on " << socket_path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    
+    // A client disconnecting mid-response must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+    
+    Daemon daemon(opts);
+    cout << "Listening on " << socket_path << " with " << opts.num_threads 
+         << " threads" << endl;
+    
+    bool running = true;
+    while (running) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            cerr << "Error: accept failed: " << strerror(errno) << endl;
+            break;
+        }
+        running = daemon.serve(fd);
+        close(fd);
+    }
+    
+    close(listener);
+    unlink(socket_path.c_str());
+    cout << "Daemon stopped after " << daemon.rowCount() << " logs in " 
+         << daemon.batchCount() << " batches" << endl;
+    return 0;
+}
+
+// Streams a CSV file to a daemon in batches and prints the results as
+// scenario_d_results.csv would contain them. Per-batch round-trip
+// latency goes to stderr.
+int runClient(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: scenario_d client <socket> <input.csv> [--batch N]" << endl;
+        cerr << "       scenario_d client <socket> stats|reset|shutdown" << endl;
+        return 1;
+    }
+    string socket_path = argv[1];
+    string target = argv[2];
+    size_t batch_rows = 1000;
+    for (int i = 3; i < argc; i++) {
+        if (string(argv[i]) == "--batch" && i + 1 < argc && 
+            (!parseNumber(string(argv[++i]), batch_rows) || batch_rows == 0)) {
+            cerr << "Error: Invalid batch size '" << argv[i] << "'" << endl;
+            return 1;
+        }
+    }
+    
+    int fd = connectUnixSocket(socket_path);
+    if (fd < 0) {
+        cerr << "Error: Cannot connect to " << socket_path << endl;
+        return 1;
+    }
+    FrameChannel channel(fd);
+    string word, payload;
+    
+    // Control requests
+    if (target == "stats" || target == "reset" || target == "shutdown") {
+        string request = target;
+        transform(request.begin(), request.end(), request.begin(), ::toupper);
+        bool ok = channel.writeFrame(request, "") && channel.readFrame(word, payload);
+        close(fd);
+        if (!ok || word != "OK") {
+            cerr << "Error: " << (ok ? payload : "connection lost") << endl;
+            return 1;
+        }
+        cout << payload;
+        return 0;
+    }
+    
+    ifstream in(target);
+    if (!in.is_open()) {
+        cerr << "Error: Cannot open file " << target << endl;
+        close(fd);
+        return 1;
+    }
+    // Every batch carries the header so the daemon can map its columns
+    string header;
+    getline(in, header);
+    header += '\n';
+    string line;
+    
+    writeResultHeader(cout);
+    vector<double> latencies;
+    size_t rows = 0;
+    auto start = chrono::high_resolution_clock::now();
+    
+    while (in) {
+        string batch = header;
+        size_t n = 0;
+        while (n < batch_rows && getline(in, line)) {
+            if (line.empty()) continue;
+            batch += line;
+            batch += '\n';
+            n++;
+        }
+        if (n == 0) break;
+        
+        auto sent = chrono::high_resolution_clock::now();
+        if (!channel.writeFrame("BATCH", batch) || !channel.readFrame(word, payload) || word != "OK") {
+            cerr << "Error: Batch " << latencies.size() << " failed" << endl;
+            close(fd);
+            return 1;
+        }
+        auto received = chrono::high_resolution_clock::now();
+        latencies.push_back(chrono::duration<double, milli>(received - sent).count());
+        rows += n;
+        cout << payload;
+    }
+    close(fd);
+    
+    double total = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+    if (!latencies.empty()) {
+        vector<double> sorted = latencies;
+        sort(sorted.begin(), sorted.end());
+        cerr << rows << " logs in " << latencies.size() << " batches, "
+             << fixed << setprecision(2) << rows / total << " logs/sec" << endl;
+        cerr << "Batch latency ms: p50 " << sorted[sorted.size() / 2]
+             << ", p99 " << sorted[min(sorted.size() - 1, sorted.size() * 99 / 100)]
+             << ", max " << sorted.back() << endl;
+    }
+    return 0;
+}
+
+// ============================================================================
+// Syslog Ingestion
+// ============================================================================
+
+// Maps a syslog message onto the LogEntry fields the pipeline reads.
+// RFC 5424: <PRI>1 TIMESTAMP HOST APP PROCID MSGID SD MSG
+// RFC 3164: <PRI>Mmm dd hh:mm:ss HOST TAG[pid]: MSG
+// The host becomes the node, APP/TAG the component, MSGID the EventId and
+// the PRI severity the level. Ground truth is unknown ("-").
+static const char* const kSyslogLevels[8] = {
+    "FATAL", "FATAL", "FATAL", "ERROR", "WARNING", "INFO", "INFO", "INFO"
+};
+
+static const char* const kMonthNames[12] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+// Next space-delimited field of `msg` starting at `pos`
+string syslogField(const string& msg, size_t& pos) {
+    size_t end = msg.find(' ', pos);
+    if (end == string::npos) end = msg.size();
+    string field = msg.substr(pos, end - pos);
+    pos = min(msg.size(), end + 1);
+    return field;
+}
+
+// RFC 3339 timestamp, e.g. 2005-06-03T15:42:50.675872-07:00
+int64_t parseRFC3339(const string& ts) {
+    struct tm t = {};
+    int consumed = 0;
+    if (sscanf(ts.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d%n", &t.tm_year, &t.tm_mon, &t.tm_mday,
+               &t.tm_hour, &t.tm_min, &t.tm_sec, &consumed) != 6) {
+        return -1;
+    }
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    int64_t seconds = timegm(&t);
+    
+    size_t p = consumed;
+    if (p < ts.size() && ts[p] == '.') {
+        while (++p < ts.size() && isDigitChar(ts[p])) {}
+    }
+    int off_h = 0, off_m = 0;
+    if (p < ts.size() && (ts[p] == '+' || ts[p] == '-') &&
+        sscanf(ts.c_str() + p + 1, "%2d:%2d", &off_h, &off_m) == 2) {
+        int64_t offset = off_h * 3600 + off_m * 60;
+        seconds += ts[p] == '+' ? -offset : offset;
+    }
+    return seconds;
+}
+
+bool parseSyslog(const string& msg, int line_id, LogEntry& log) {
+    if (msg.size() < 3 || msg[0] != '<') return false;
+    size_t close = msg.find('>');
+    if (close == string::npos || close < 2 || close > 4) return false;
+    int pri = 0;
+    for (size_t i = 1; i < close; i++) {
+        if (!isDigitChar(msg[i])) return false;
+        pri = pri * 10 + (msg[i] - '0');
+    }
+    
+    log = LogEntry();
+    log.line_id = line_id;
+    log.label = "-";
+    log.level = kSyslogLevels[pri & 7];
+    
+    size_t pos = close + 1;
+    if (msg.compare(pos, 2, "1 ") == 0) {
+        pos += 2;
+        log.unix_time = parseRFC3339(syslogField(msg, pos));
+        log.node = syslogField(msg, pos);
+        log.component = syslogField(msg, pos);
+        syslogField(msg, pos);   // PROCID
+        log.event_id = syslogField(msg, pos);
+        
+        // Structured data: "-" or one or more [...] elements
+        if (pos < msg.size() && msg[pos] == '[') {
+            size_t end = msg.find("] ", pos);
+            pos = end == string::npos ? msg.size() : end + 2;
+            while (pos < msg.size() && msg[pos] == '[') {
+                end = msg.find("] ", pos);
+                pos = end == string::npos ? msg.size() : end + 2;
+            }
+        } else {
+            syslogField(msg, pos);
+        }
+        if (log.node == "-") log.node.clear();
+        if (log.component == "-") log.component.clear();
+        if (log.event_id == "-") log.event_id.clear();
+    } else {
+        if (msg.size() < pos + 16) return false;
+        auto month = find_if(begin(kMonthNames), end(kMonthNames), [&](const char* m) {
+            return msg.compare(pos, 3, m) == 0;
+        });
+        if (month == end(kMonthNames)) return false;
+        
+        // No year on the wire: assume the current one
+        time_t now = time(nullptr);
+        struct tm t;
+        gmtime_r(&now, &t);
+        t.tm_mon = int(month - begin(kMonthNames));
+        if (sscanf(msg.c_str() + pos + 4, "%2d %2d:%2d:%2d", &t.tm_mday, 
+                   &t.tm_hour, &t.tm_min, &t.tm_sec) != 4) {
+            return false;
+        }
+        log.unix_time = timegm(&t);
+        pos += 16;
+        log.node = syslogField(msg, pos);
+        
+        // TAG ends at '[', ':' or a space
+        size_t tag_end = msg.find_first_of("[: ", pos);
+        if (tag_end != string::npos && msg[tag_end] != ' ') {
+            log.component = msg.substr(pos, tag_end - pos);
+            size_t colon = msg.find(':', tag_end);
+            pos = colon == string::npos ? tag_end : colon + 1;
+            if (pos < msg.size() && msg[pos] == ' ') pos++;
+        }
+    }
+    
+    log.content = msg.substr(pos);
+    while (!log.content.empty() && (log.content.back() == '\n' || log.content.back() == '\r')) {
+        log.content.pop_back();
+    }
+    log.topology = decodeNode(log.node.data(), log.node.size());
+    log.timestamp = log.unix_time >= 0 ? to_string(log.unix_time) : "";
+    return true;
+}
+
+// Single-producer single-consumer ring; each receive thread owns one and
+// the processing loop drains them all. No locks on either side.
+template <typename T>
+class SpscRing {
+private:
+    vector<T> slots;
+    size_t mask;
+    alignas(64) atomic<size_t> head{0};   // next slot to pop (consumer)
+    alignas(64) atomic<size_t> tail{0};   // next slot to fill (producer)
+    
+public:
+    explicit SpscRing(size_t capacity_pow2) : slots(capacity_pow2), mask(capacity_pow2 - 1) {}
+    
+    bool push(T&& value) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == slots.size()) return false;
+        slots[t & mask] = move(value);
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+    
+    // Approximate when called concurrently with push/pop
+    size_t size() const {
+        return tail.load(memory_order_acquire) - head.load(memory_order_acquire);
+    }
+    
+    bool pop(T& value) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire)) return false;
+        value = move(slots[h & mask]);
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+};
+
+using MessageBatch = vector<string>;
+
+struct alignas(64) IngestCounters {
+    atomic<uint64_t> received{0};
+    atomic<uint64_t> dropped{0};          // ring full: pipeline behind
+    atomic<uint64_t> kernel_dropped{0};   // socket buffer overflow (UDP)
+    atomic<uint64_t> connections{0};      // accepted (TCP)
+};
+
+static volatile sig_atomic_t g_stop_listening = 0;
+
+void onStopSignal(int) { g_stop_listening = 1; }
+
+// One receive thread per socket. Messages are handed to the processing
+// loop in batches through the thread's ring.
+class SyslogReceiver {
+private:
+    int fd;
+    bool udp;
+    SpscRing<MessageBatch> ring;
+    IngestCounters counters;
+    thread worker;
+    atomic<bool> stopping{false};
+    
+    static const size_t kHandoffMessages = 256;
+    static const int kMaxDatagram = 8192;
+    
+    // UDP cannot push back, so a full ring drops the batch
+    void handoff(MessageBatch& batch) {
+        if (batch.empty()) return;
+        size_t n = batch.size();
+        bool pushed = ring.push(move(batch));
+        if (!udp) {
+            // TCP: stop reading until the pipeline catches up, which
+            // lets the sender see backpressure instead of losing lines.
+            // Only a stop with the ring still full gives up on the batch.
+            while (!pushed && !stopping) {
+                this_thread::sleep_for(chrono::microseconds(200));
+                pushed = ring.push(move(batch));
+            }
+        }
+        if (!pushed) counters.dropped += n;
+        batch.clear();
+    }
+    
+    void runUdp() {
+        const int kBatch = 64;
+        vector<char> buffers(kBatch * kMaxDatagram);
+        vector<mmsghdr> msgs(kBatch);
+        vector<iovec> iovs(kBatch);
+        const size_t kControl = CMSG_SPACE(sizeof(uint32_t));
+        vector<char> controls(kBatch * kControl);
+        MessageBatch batch;
+        
+        while (!stopping) {
+            for (int i = 0; i < kBatch; i++) {
+                iovs[i].iov_base = &buffers[i * kMaxDatagram];
+                iovs[i].iov_len = kMaxDatagram;
+                msgs[i].msg_hdr = {};
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_control = &controls[i * kControl];
+                msgs[i].msg_hdr.msg_controllen = kControl;
+            }
             
-            getline(ss, field, ','); 
-            log.level = field;
+            int n = recvmmsg(fd, msgs.data(), kBatch, MSG_WAITFORONE, nullptr);
+            if (n <= 0) {
+                // Timeout: hand off whatever is pending to bound latency
+                handoff(batch);
+                continue;
+            }
             
-            getline(ss, field, ','); 
-            log.content = field;
+            for (int i = 0; i < n; i++) {
+                batch.emplace_back(&buffers[i * kMaxDatagram], msgs[i].msg_len);
+            }
+            counters.received += n;
             
-            getline(ss, field, ','); // EventId (skip)
+            // SO_RXQ_OVFL: cumulative datagrams the kernel dropped
+            for (cmsghdr* c = CMSG_FIRSTHDR(&msgs[n - 1].msg_hdr); c; 
+                 c = CMSG_NXTHDR(&msgs[n - 1].msg_hdr, c)) {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+                    uint32_t drops;
+                    memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+                    counters.kernel_dropped = drops;
+                }
+            }
+            if (batch.size() >= kHandoffMessages) handoff(batch);
+        }
+        handoff(batch);
+    }
+    
+    void runTcp() {
+        // Newline-framed streams, one partial line buffer per connection
+        vector<pollfd> fds{{fd, POLLIN, 0}};
+        vector<string> partial{""};
+        MessageBatch batch;
+        char chunk[65536];
+        
+        while (!stopping) {
+            int ready = poll(fds.data(), fds.size(), 100);
+            if (ready <= 0) {
+                handoff(batch);
+                continue;
+            }
             
-            getline(ss, field, ','); 
-            log.event_template = field;
+            if (fds[0].revents & POLLIN) {
+                int conn = accept(fd, nullptr, nullptr);
+                if (conn >= 0) {
+                    fds.push_back({conn, POLLIN, 0});
+                    partial.emplace_back();
+                    counters.connections++;
+                }
+            }
             
-            logs.push_back(log);
+            for (size_t c = 1; c < fds.size(); c++) {
+                if (!(fds[c].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+                ssize_t n = read(fds[c].fd, chunk, sizeof(chunk));
+                if (n <= 0) {
+                    if (!partial[c].empty()) {
+                        batch.push_back(move(partial[c]));
+                        counters.received++;
+                    }
+                    close(fds[c].fd);
+                    fds[c].fd = -1;
+                    continue;
+                }
+                
+                string& buf = partial[c];
+                buf.append(chunk, n);
+                size_t start = 0, newline;
+                while ((newline = buf.find('\n', start)) != string::npos) {
+                    if (newline > start) {
+                        batch.emplace_back(buf, start, newline - start);
+                        counters.received++;
+                    }
+                    start = newline + 1;
+                }
+                buf.erase(0, start);
+                if (batch.size() >= kHandoffMessages) handoff(batch);
+            }
             
-        } catch (const exception& e) {
-            cerr << "Warning: Failed to parse line " << line_count << ": " << e.what() << endl;
-            continue;
+            // Compact closed connections
+            for (size_t c = fds.size() - 1; c >= 1; c--) {
+                if (fds[c].fd < 0) {
+                    fds.erase(fds.begin() + c);
+                    partial.erase(partial.begin() + c);
+                }
+            }
         }
+        for (size_t c = 1; c < fds.size(); c++) close(fds[c].fd);
+        handoff(batch);
     }
     
-    cout << "Loaded " << logs.size() << " logs from " << filename << endl;
-    return logs;
-}
-
-// ============================================================================
-// Performance Statistics
-// ============================================================================
+public:
+    static const size_t kRingBatches = 1024;
+    
+    SyslogReceiver(int socket_fd, bool is_udp) 
+        : fd(socket_fd), udp(is_udp), ring(kRingBatches) {}
+    
+    ~SyslogReceiver() {
+        stop();
+        close(fd);
+    }
+    
+    void start() {
+        worker = thread([this]() { udp ? runUdp() : runTcp(); });
+    }
+    
+    void stop() {
+        stopping = true;
+        if (worker.joinable()) worker.join();
+    }
+    
+    bool take(MessageBatch& batch) { return ring.pop(batch); }
+    size_t queuedBatches() const { return ring.size(); }
+    const IngestCounters& stats() const { return counters; }
+    const char* protocol() const { return udp ? "udp" : "tcp"; }
+};
 
-PerformanceStats calculateStats(const vector<LogEntry>& logs, 
-                                double total_time_sec,
-                                int num_threads) {
-    PerformanceStats stats;
+// Degrades the listener predictably when the receive queues fill up.
+// Shedding engages at `shed_at` queue occupancy and releases below half
+// of it. Policies:
+//   block           never shed; TCP senders block, UDP overflows the ring
+//   drop-info       discard INFO rows
+//   sample          keep 1 in `sample_every` INFO rows
+//   template-cache  reuse Stage 1 results per (EventId, level)
+// Under every policy a full ring still blocks TCP and drops UDP.
+class LoadShedder {
+public:
+    enum Policy { BLOCK, DROP_INFO, SAMPLE, TEMPLATE_CACHE };
     
-    stats.total_logs = logs.size();
-    stats.num_threads = num_threads;
-    stats.total_time_sec = total_time_sec;
+private:
+    Policy policy;
+    double high_water;
+    double low_water;
+    int sample_every;
+    bool engaged = false;
+    uint64_t info_seen = 0;
+    TemplateCache cache;
     
-    double sum_stage1 = 0, sum_stage2 = 0;
-    int total_keywords = 0, total_keyword_chars = 0;
-    int correct = 0;
+public:
+    atomic<uint64_t> engagements{0};
+    atomic<uint64_t> dropped{0};        // drop-info
+    atomic<uint64_t> sampled_out{0};    // sample
+    atomic<uint64_t> cached{0};         // template-cache
+    atomic<double> occupancy{0};
     
-    for (const auto& log : logs) {
-        sum_stage1 += log.stage1_time_ms;
-        sum_stage2 += log.stage2_time_ms;
-        
-        total_keywords += log.keywords.size();
-        for (const auto& kw : log.keywords) {
-            total_keyword_chars += kw.length();
-        }
-        
-        if (log.predicted_label == log.label) {
-            correct++;
+    static bool parsePolicy(const string& name, Policy& policy) {
+        if (name == "block") policy = BLOCK;
+        else if (name == "drop-info") policy = DROP_INFO;
+        else if (name == "sample") policy = SAMPLE;
+        else if (name == "template-cache") policy = TEMPLATE_CACHE;
+        else return false;
+        return true;
+    }
+    
+    LoadShedder(Policy p, double shed_at, int every)
+        : policy(p), high_water(shed_at), low_water(shed_at / 2), sample_every(every) {}
+    
+    bool isEngaged() const { return engaged; }
+    
+    // Called once per segment with the current queue occupancy (0..1)
+    void update(double queue_occupancy) {
+        occupancy = queue_occupancy;
+        if (!engaged && queue_occupancy >= high_water && policy != BLOCK) {
+            engaged = true;
+            engagements++;
+        } else if (engaged && queue_occupancy <= low_water && queue_occupancy < high_water) {
+            engaged = false;
         }
     }
     
-    stats.stage1_time_sec = sum_stage1 / 1000.0;
-    stats.stage2_time_sec = sum_stage2 / 1000.0;
-    stats.throughput_logs_per_sec = logs.size() / total_time_sec;
-    stats.avg_time_per_log_ms = (sum_stage1 + sum_stage2) / logs.size();
+    // Drops or samples INFO rows before processing
+    void filter(vector<LogEntry>& logs) {
+        if (!engaged || (policy != DROP_INFO && policy != SAMPLE)) return;
+        
+        size_t before = logs.size();
+        auto keep_end = remove_if(logs.begin(), logs.end(), [this](const LogEntry& log) {
+            if (log.level != "INFO") return false;
+            return policy == DROP_INFO || info_seen++ % sample_every != 0;
+        });
+        logs.erase(keep_end, logs.end());
+        (policy == DROP_INFO ? dropped : sampled_out) += before - logs.size();
+    }
     
-    double total_stage_time = stats.stage1_time_sec + stats.stage2_time_sec;
-    if (total_stage_time > 0) {
-        stats.stage1_percentage = (stats.stage1_time_sec / total_stage_time) * 100.0;
-        stats.stage2_percentage = (stats.stage2_time_sec / total_stage_time) * 100.0;
+    // Template cache to hand to the pipeline for this segment, if any
+    const TemplateCache* templateCache() const {
+        return engaged && policy == TEMPLATE_CACHE ? &cache : nullptr;
     }
     
-    stats.correct_predictions = correct;
-    stats.accuracy_percentage = (100.0 * correct) / logs.size();
+    // After processing: learn templates, count rows served from the cache
+    void record(const vector<LogEntry>& logs, bool used_cache) {
+        if (policy != TEMPLATE_CACHE) return;
+        if (used_cache) {
+            // The cache did not change during the segment, so a row was
+            // served from it exactly when its template is present
+            uint64_t hits = 0;
+            for (const auto& log : logs) hits += cache.contains(log);
+            cached += hits;
+        }
+        cache.learn(logs);
+    }
     
-    stats.avg_keywords_count = (double)total_keywords / logs.size();
-    stats.avg_keywords_chars = (double)total_keyword_chars / logs.size();
+    const char* policyName() const {
+        static const char* const names[] = {"block", "drop-info", "sample", "template-cache"};
+        return names[policy];
+    }
+};
+
+int openSyslogSocket(const string& bind_addr, int port, bool udp) {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, bind_addr.c_str(), &addr.sin_addr) != 1) return -1;
     
-    return stats;
+    int fd = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (udp) {
+        // Large receive buffer absorbs bursts; a short timeout lets the
+        // receive thread flush partial batches and notice shutdown
+        int rcvbuf = 8 * 1024 * 1024;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+        timeval timeout = {0, 100000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        (!udp && listen(fd, 64) != 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
-void printStats(const PerformanceStats& stats) {
-    cout << "\n" << string(80, '=') << endl;
-    cout << "PERFORMANCE ANALYSIS SUMMARY" << endl;
-    cout << string(80, '=') << endl;
+int runListener(int argc, char* argv[]) {
+    RunOptions opts;
+    if (!parseArgs(argc, argv, opts) || argc < 2 || (!opts.udp_port && !opts.tcp_port)) {
+        cerr << "Usage: scenario_d listen <bind_addr> <output_dir> <num_threads> "
+             << "[--udp PORT] [--tcp PORT] [--duration SEC] [options]" << endl;
+        return 1;
+    }
+    const string& bind_addr = opts.input_file;
     
-    cout << "\n--- Overall Throughput ---" << endl;
-    cout << "Total logs: " << stats.total_logs << endl;
-    cout << "Threads: " << stats.num_threads << endl;
-    cout << "Total time: " << fixed << setprecision(3) << stats.total_time_sec << " seconds" << endl;
-    cout << "Throughput: " << fixed << setprecision(2) << stats.throughput_logs_per_sec << " logs/sec" << endl;
-    cout << "Avg time per log: " << fixed << setprecision(3) << stats.avg_time_per_log_ms << " ms" << endl;
+    LoadShedder::Policy policy;
+    if (!LoadShedder::parsePolicy(opts.shed_policy, policy)) {
+        cerr << "Error: Unknown shedding policy '" << opts.shed_policy << "'" << endl;
+        return 1;
+    }
+    LoadShedder shedder(policy, opts.shed_at, opts.sample_every);
     
-    cout << "\n--- Stage Breakdown ---" << endl;
-    cout << "Stage 1: " << fixed << setprecision(3) << stats.stage1_time_sec << "s (" 
-         << fixed << setprecision(1) << stats.stage1_percentage << "%)" << endl;
-    cout << "Stage 2: " << fixed << setprecision(3) << stats.stage2_time_sec << "s (" 
-         << fixed << setprecision(1) << stats.stage2_percentage << "%)" << endl;
+    vector<unique_ptr<SyslogReceiver>> receivers;
+    for (int udp = 1; udp >= 0; udp--) {
+        int port = udp ? opts.udp_port : opts.tcp_port;
+        if (!port) continue;
+        int fd = openSyslogSocket(bind_addr, port, udp);
+        if (fd < 0) {
+            cerr << "Error: Cannot listen on " << (udp ? "udp " : "tcp ") << bind_addr 
+                 << ":" << port << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        receivers.emplace_back(new SyslogReceiver(fd, udp));
+        cout << "Listening on " << (udp ? "udp " : "tcp ") << bind_addr << ":" << port << endl;
+    }
     
-    cout << "\n--- Prediction Accuracy ---" << endl;
-    cout << "Correct: " << stats.correct_predictions << "/" << stats.total_logs << endl;
-    cout << "Accuracy: " << fixed << setprecision(1) << stats.accuracy_percentage << "%" << endl;
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+    signal(SIGPIPE, SIG_IGN);
     
-    cout << "\n--- Keywords Statistics ---" << endl;
-    cout << "Avg keywords per log: " << fixed << setprecision(1) << stats.avg_keywords_count << endl;
-    cout << "Avg chars per log: " << fixed << setprecision(1) << stats.avg_keywords_chars << endl;
+    // Declared before the pipeline: its metrics server reads this until
+    // the pipeline is destroyed
+    atomic<uint64_t> parse_errors{0};
+    Daemon pipeline(opts, false);   // syslog rows have no ground truth
+    unique_ptr<ResultStoreWriter> store;
+    string store_file = opts.output_dir + "scenario_d_results.col";
+    if (opts.store) {
+        store.reset(new ResultStoreWriter(store_file, true, pipeline.labelNames()));
+        if (!store->isOpen()) {
+            cerr << "Error: Cannot create " << store_file << endl;
+            return 1;
+        }
+    }
+    if (PipelineMetrics* metrics = pipeline.metrics()) {
+        metrics->addCollector([&](ostream& out) {
+            out << "# HELP scenario_d_ingest_received_total Syslog messages received.\n";
+            out << "# TYPE scenario_d_ingest_received_total counter\n";
+            for (auto& r : receivers) {
+                out << "scenario_d_ingest_received_total{protocol=\"" << r->protocol() << "\"} " 
+                    << r->stats().received << "\n";
+            }
+            out << "# HELP scenario_d_ingest_dropped_total Syslog messages dropped.\n";
+            out << "# TYPE scenario_d_ingest_dropped_total counter\n";
+            for (auto& r : receivers) {
+                out << "scenario_d_ingest_dropped_total{protocol=\"" << r->protocol() 
+                    << "\",reason=\"pipeline\"} " << r->stats().dropped << "\n";
+                out << "scenario_d_ingest_dropped_total{protocol=\"" << r->protocol() 
+                    << "\",reason=\"socket\"} " << r->stats().kernel_dropped << "\n";
+            }
+            out << "# HELP scenario_d_ingest_queue_batches Batches waiting for the pipeline.\n";
+            out << "# TYPE scenario_d_ingest_queue_batches gauge\n";
+            for (auto& r : receivers) {
+                out << "scenario_d_ingest_queue_batches{protocol=\"" << r->protocol() << "\"} " 
+                    << r->queuedBatches() << "\n";
+            }
+            out << "# HELP scenario_d_ingest_parse_errors_total Unparseable syslog messages.\n";
+            out << "# TYPE scenario_d_ingest_parse_errors_total counter\n";
+            out << "scenario_d_ingest_parse_errors_total " << parse_errors << "\n";
+            
+            out << "# HELP scenario_d_ingest_queue_occupancy Fill level of the receive queues (0-1).\n";
+            out << "# TYPE scenario_d_ingest_queue_occupancy gauge\n";
+            out << "scenario_d_ingest_queue_occupancy " << shedder.occupancy.load() << "\n";
+            out << "# HELP scenario_d_shed_engagements_total Times load shedding engaged.\n";
+            out << "# TYPE scenario_d_shed_engagements_total counter\n";
+            out << "scenario_d_shed_engagements_total{policy=\"" << shedder.policyName() << "\"} " 
+                << shedder.engagements << "\n";
+            out << "# HELP scenario_d_shed_rows_total Rows affected by load shedding.\n";
+            out << "# TYPE scenario_d_shed_rows_total counter\n";
+            out << "scenario_d_shed_rows_total{action=\"dropped\"} " << shedder.dropped << "\n";
+            out << "scenario_d_shed_rows_total{action=\"sampled_out\"} " << shedder.sampled_out << "\n";
+            out << "scenario_d_shed_rows_total{action=\"cached\"} " << shedder.cached << "\n";
+        });
+    }
+    for (auto& r : receivers) r->start();
     
-    cout << "\n--- Memory Usage ---" << endl;
-    cout << "Peak memory: " << stats.peak_memory_mb << " MB" << endl;
-
-    cout << string(80, '=') << endl;
-}
-
-void saveStatsJSON(const PerformanceStats& stats, const string& filename) {
-    ofstream out(filename);
+    // Processing loop: drain the rings into segments and run the pipeline
+    const size_t kSegmentMessages = 8192;
+    auto start = chrono::steady_clock::now();
+    auto last_report = start;
+    uint64_t reported_drops = 0;
+    int next_line_id = 1;
+    MessageBatch batch;
+    vector<LogEntry> logs;
     
-    out << "{\n";
-    out << "  \"metadata\": {\n";
-    out << "    \"scenario\": \"scenario_d\",\n";
-    out << "    \"total_logs_processed\": " << stats.total_logs << ",\n";
-    out << "    \"num_threads\": " << stats.num_threads << ",\n";
-    out << "    \"total_time_seconds\": " << fixed << setprecision(6) << stats.total_time_sec << "\n";
-    out << "  },\n";
-    out << "  \"throughput\": {\n";
-    out << "    \"logs_per_second\": " << fixed << setprecision(3) << stats.throughput_logs_per_sec << ",\n";
-    out << "    \"avg_time_per_log_ms\": " << fixed << setprecision(3) << stats.avg_time_per_log_ms << "\n";
-    out << "  },\n";
-    out << "  \"stage_breakdown\": {\n";
-    out << "    \"stage1_time_sec\": " << fixed << setprecision(6) << stats.stage1_time_sec << ",\n";
-    out << "    \"stage2_time_sec\": " << fixed << setprecision(6) << stats.stage2_time_sec << ",\n";
-    out << "    \"stage1_percentage\": " << fixed << setprecision(2) << stats.stage1_percentage << ",\n";
-    out << "    \"stage2_percentage\": " << fixed << setprecision(2) << stats.stage2_percentage << "\n";
-    out << "  },\n";
-    out << "  \"accuracy\": {\n";
-    out << "    \"correct\": " << stats.correct_predictions << ",\n";
-    out << "    \"total\": " << stats.total_logs << ",\n";
-    out << "    \"accuracy_percentage\": " << fixed << setprecision(2) << stats.accuracy_percentage << "\n";
-    out << "  },\n";
-    out << "  \"keywords_statistics\": {\n";
-    out << "    \"avg_keywords_count\": " << fixed << setprecision(2) << stats.avg_keywords_count << ",\n";
-    out << "    \"avg_keywords_chars\": " << fixed << setprecision(2) << stats.avg_keywords_chars << "\n";
-    out << "  },\n";
-    out << "  \"memory_usage\": {\n";
-    out << "    \"peak_memory_mb\": " << stats.peak_memory_mb << "\n";
-    out << "  }\n";
-    out << "}\n";
+    auto drainAndProcess = [&]() {
+        logs.clear();
+        bool any = true;
+        while (any && logs.size() < kSegmentMessages) {
+            any = false;
+            for (auto& r : receivers) {
+                if (!r->take(batch)) continue;
+                any = true;
+                for (const auto& msg : batch) {
+                    logs.emplace_back();
+                    if (!parseSyslog(msg, next_line_id++, logs.back())) {
+                        logs.pop_back();
+                        parse_errors++;
+                    }
+                }
+            }
+        }
+        if (logs.empty()) return false;
+        
+        size_t queued = 0;
+        for (auto& r : receivers) queued += r->queuedBatches();
+        shedder.update(double(queued) / (receivers.size() * SyslogReceiver::kRingBatches));
+        shedder.filter(logs);
+        
+        const TemplateCache* cache = shedder.templateCache();
+        pipeline.process(logs, cache);
+        shedder.record(logs, cache != nullptr);
+        if (store) store->append(logs);
+        return true;
+    };
     
-    cout << "\nPerformance stats saved to: " << filename << endl;
-}
-
-void saveDetailedResults(const vector<LogEntry>& logs, const string& filename) {
-    ofstream out(filename);
+    while (!g_stop_listening) {
+        if (!drainAndProcess()) this_thread::sleep_for(chrono::milliseconds(1));
+        
+        auto now = chrono::steady_clock::now();
+        if (opts.duration_sec > 0 && now - start >= chrono::seconds(opts.duration_sec)) break;
+        
+        if (now - last_report >= chrono::seconds(5)) {
+            uint64_t drops = 0;
+            for (auto& r : receivers) drops += r->stats().dropped + r->stats().kernel_dropped;
+            cout << "  Processed: " << pipeline.rowCount();
+            if (drops > reported_drops) {
+                cout << " (pipeline behind: " << drops - reported_drops << " messages dropped)";
+                reported_drops = drops;
+            }
+            if (shedder.isEngaged()) cout << " (shedding load: " << shedder.policyName() << ")";
+            cout << endl;
+            last_report = now;
+        }
+    }
     
-    out << "LineId,GroundTruth,PredictedLabel,Confidence,Severity,"
-        << "Stage1TimeMs,Stage2TimeMs,TotalTimeMs,KeywordsCount\n";
+    // Receivers hand off their last partial batches before exiting
+    for (auto& r : receivers) r->stop();
+    while (drainAndProcess()) {}
     
-    for (const auto& log : logs) {
-        out << log.line_id << ","
-            << log.label << ","
-            << log.predicted_label << ","
-            << log.confidence << ","
-            << log.severity_level << ","
-            << fixed << setprecision(3) << log.stage1_time_ms << ","
-            << fixed << setprecision(3) << log.stage2_time_ms << ","
-            << fixed << setprecision(3) << (log.stage1_time_ms + log.stage2_time_ms) << ","
-            << log.keywords.size() << "\n";
+    cout << "\n--- Ingestion ---" << endl;
+    for (auto& r : receivers) {
+        const IngestCounters& c = r->stats();
+        cout << r->protocol() << ": received " << c.received 
+             << ", dropped (pipeline behind) " << c.dropped
+             << ", dropped (socket buffer) " << c.kernel_dropped;
+        if (c.connections > 0) cout << ", connections " << c.connections;
+        cout << endl;
     }
+    cout << "Unparseable messages: " << parse_errors << endl;
+    cout << "Load shedding (" << shedder.policyName() << "): engaged " << shedder.engagements 
+         << " times, dropped " << shedder.dropped << ", sampled out " << shedder.sampled_out
+         << ", from template cache " << shedder.cached << endl;
+    cout << "Processed: " << pipeline.rowCount() << " logs" << endl;
     
-    cout << "Detailed results saved to: " << filename << endl;
+    pipeline.saveOutputs();
+    if (store) {
+        store->finish();
+        cout << "Result store saved to: " << store_file 
+             << " (" << store->blockCount() << " blocks)" << endl;
+    }
+    return 0;
 }
 
-void printLabelDistribution(const vector<LogEntry>& logs) {
-    map<string, int> ground_truth_dist;
-    map<string, int> predicted_dist;
+// Test generator: replays a BGL CSV as RFC 5424 syslog messages, carrying
+// Node as HOSTNAME, Component as APP-NAME and EventId as MSGID.
+int runLogGenerator(int argc, char* argv[]) {
+    if (argc < 5) {
+        cerr << "Usage: scenario_d loggen <udp|tcp> <host> <port> <input.csv> [--rate N]" << endl;
+        return 1;
+    }
+    bool udp = string(argv[1]) == "udp";
+    string host = argv[2];
+    int port = 0;
+    if (!parseNumber(string(argv[3]), port)) {
+        cerr << "Error: Invalid port '" << argv[3] << "'" << endl;
+        return 1;
+    }
+    string input = argv[4];
+    long rate = 0;
+    for (int i = 5; i < argc; i++) {
+        if (string(argv[i]) == "--rate" && i + 1 < argc && !parseNumber(string(argv[++i]), rate)) {
+            cerr << "Error: Invalid rate '" << argv[i] << "'" << endl;
+            return 1;
+        }
+    }
     
-    for (const auto& log : logs) {
-        ground_truth_dist[log.label]++;
-        predicted_dist[log.predicted_label]++;
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    int fd = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (fd < 0 || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+        connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        cerr << "Error: Cannot connect to " << host << ":" << port << endl;
+        return 1;
     }
     
-    cout << "\n--- Label Distribution ---" << endl;
+    CSVReader reader(input);
+    if (!reader.isOpen()) return 1;
     
-    cout << "\nGround Truth:" << endl;
-    for (const auto& [label, count] : ground_truth_dist) {
-        cout << "  " << (label.empty() || label == "-" ? "Normal (-)" : label) 
-             << ": " << count << endl;
+    LogEntry log;
+    size_t sent = 0;
+    string msg;
+    auto start = chrono::steady_clock::now();
+    while (reader.next(log)) {
+        int severity = log.level == "FATAL" ? 2 : log.level == "ERROR" ? 3 : 
+                       log.level == "WARNING" ? 4 : 6;
+        time_t ts = log.unix_time >= 0 ? log.unix_time : 0;
+        struct tm t;
+        gmtime_r(&ts, &t);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &t);
+        
+        // Facility local0 (16)
+        msg = "<" + to_string(16 * 8 + severity) + ">1 " + stamp + " " +
+              (log.node.empty() ? "-" : log.node) + " " + 
+              (log.component.empty() ? "-" : log.component) + " - " +
+              (log.event_id.empty() ? "-" : log.event_id) + " - " + log.content;
+        if (!udp) msg += '\n';
+        
+        if (send(fd, msg.data(), msg.size(), 0) < 0) {
+            cerr << "Error: send failed after " << sent << " messages: " << strerror(errno) << endl;
+            break;
+        }
+        sent++;
+        
+        if (rate > 0) {
+            auto due = start + chrono::microseconds(sent * 1000000 / rate);
+            this_thread::sleep_until(due);
+        }
     }
+    close(fd);
     
-    cout << "\nPredicted:" << endl;
-    for (const auto& [label, count] : predicted_dist) {
-        cout << "  " << (label.empty() || label == "-" ? "Normal (-)" : label) 
-             << ": " << count << endl;
-    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << "Sent " << sent << " messages in " << fixed << setprecision(3) << elapsed 
+         << " s (" << setprecision(0) << sent / max(elapsed, 1e-9) << " msg/s)" << endl;
+    return 0;
 }
 
 // ============================================================================
 // Main Program
 // ============================================================================
 
+#ifndef SCENARIO_D_NO_MAIN
 int main(int argc, char* argv[]) {
-    // Parse arguments
-    string input_file = "data/subset_500.csv";
-    string output_dir = "output/";
-    int num_threads = 32;
+    // Subcommands
+    if (argc > 1 && string(argv[1]) == "query") {
+        return runQuery(argc - 1, argv + 1);
+    }
+    if (argc > 1 && string(argv[1]) == "serve") {
+        return runDaemon(argc - 1, argv + 1);
+    }
+    if (argc > 1 && string(argv[1]) == "client") {
+        return runClient(argc - 1, argv + 1);
+    }
+    if (argc > 1 && string(argv[1]) == "listen") {
+        return runListener(argc - 1, argv + 1);
+    }
+    if (argc > 1 && string(argv[1]) == "loggen") {
+        return runLogGenerator(argc - 1, argv + 1);
+    }
     
-    if (argc > 1) input_file = argv[1];
-    if (argc > 2) output_dir = argv[2];
-    if (argc > 3) num_threads = stoi(argv[3]);
+    // Parse arguments
+    RunOptions opts;
+    if (!parseArgs(argc, argv, opts)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    const string& output_dir = opts.output_dir;
+    int num_threads = opts.num_threads;
     
-    // Ensure output directory ends with /
-    if (!output_dir.empty() && output_dir.back() != '/') {
-        output_dir += '/';
+    // Segments take half of the budget, less the store's block buffer;
+    // the rest covers vector growth, arenas and I/O buffers. Checkpointed
+    // runs write one segment while processing the next, so each of the
+    // two gets half of that share.
+    size_t memory_budget = opts.memory_limit_mb * 1024 * 1024;
+    size_t block_rows = ResultStoreWriter::blockRowsFor(memory_budget / 8);
+    size_t segment_budget = 0;
+    if (memory_budget > 0) {
+        segment_budget = memory_budget / 2 - block_rows * ResultStoreWriter::kBlockRowBytes;
+        if (opts.checkpoint) segment_budget /= 2;
     }
+    if (opts.checkpoint && segment_budget == 0) segment_budget = kCheckpointSegmentBytes;
     
     cout << string(80, '=') << endl;
     cout << "SCENARIO D: C++ HPC LOG ANALYSIS" << endl;
     cout << string(80, '=') << endl;
-    cout << "Input: " << input_file << endl;
+    cout << "Input: " << opts.input_file << endl;
     cout << "Output: " << output_dir << endl;
-    cout << "Threads: " << num_threads << endl;
+    cout << "Threads: " << num_threads << " (" << opts.thread_source << ")" << endl;
+    if (opts.memory_limit_mb > 0) {
+        cout << "Memory limit: " << opts.memory_limit_mb << " MB" << endl;
+    }
     cout << string(80, '=') << endl;
     
+    // Find where a previous run stopped
+    string store_file = output_dir + (opts.store ? "scenario_d_results.col" 
+                                                 : "scenario_d_results.spill");
+    string checkpoint_file = output_dir + "scenario_d_checkpoint.log";
+    CheckpointRecord resume_from = {};
+    bool resuming = false;
+    if (opts.resume) {
+        resuming = CheckpointLog::loadLast(checkpoint_file, resume_from);
+        if (!resuming) {
+            cout << "No checkpoint in " << output_dir << ", starting from the beginning" << endl;
+        } else if (resume_from.input_size != fileSize(opts.input_file)) {
+            cerr << "Error: " << opts.input_file << " changed since the checkpoint" << endl;
+            return 1;
+        }
+    }
+    
     // Load data
     cout << "\n[1/4] Loading dataset..." << endl;
-    vector<LogEntry> logs = loadCSV(input_file);
-    
-    if (logs.empty()) {
-        cerr << "No logs loaded. Exiting." << endl;
-        return 1;
+    ColumnMask columns = requiredColumns(opts);
+    CSVReader reader(opts.input_file, columns);
+    string quarantine_file = output_dir + "scenario_d_quarantine.csv";
+    QuarantineWriter quarantine(quarantine_file);
+    if (quarantine.isOpen()) reader.setQuarantine(&quarantine);
+    cout << "Columns: " << reader.extractionPlan().mappedColumns() << "/" 
+         << reader.extractionPlan().file_columns << " materialized" << endl;
+    vector<LogEntry> logs;
+    if (!resuming) {
+        readSegment(reader, logs, segment_budget);
+        if (logs.empty()) {
+            cerr << "No logs loaded. Exiting." << endl;
+            return 1;
+        }
+    }
+    if (resuming) {
+        cout << "Resuming after " << resume_from.rows << " committed logs" << endl;
+    } else if (reader.exhausted()) {
+        cout << "Loaded " << logs.size() << " logs from " << opts.input_file << endl;
+    } else {
+        cout << "Loaded first segment of " << logs.size() << " logs from " 
+             << opts.input_file << endl;
     }
     
     // Initialize engines
     cout << "\n[2/4] Initializing engines..." << endl;
-    RuleEngine rule_engine;
+    unique_ptr<RuleEngine> engine = makeRuleEngine(opts.rule_engine);
+    RuleEngine& rule_engine = *engine;
     ReportGenerator report_gen;
-    cout << "Engines initialized" << endl;
+    cout << "Engines initialized (rule engine " << opts.rule_engine << ")" << endl;
     
-    // Set parallelization
+    AggregateConfig agg_cfg;
+    agg_cfg.top_k = opts.top_k;
+    agg_cfg.distinct_counts = opts.distinct_counts;
+    agg_cfg.topology_labels = opts.topology ? rule_engine.labelNames().size() : 0;
+    agg_cfg.cube_bucket_sec = opts.cube_bucket_sec;
+    agg_cfg.cube_labels = rule_engine.labelNames().size();
+    
+    // Set parallelization, optionally measured on the first segment
+    if (opts.calibrate && !logs.empty()) {
+        cout << "Calibrating thread count on " << min(logs.size(), kCalibrationRows) 
+             << " logs..." << endl;
+        num_threads = calibrateThreads(logs, rule_engine, agg_cfg, opts.dedup, num_threads);
+    } else if (opts.calibrate) {
+        cout << "Calibration skipped when resuming" << endl;
+    }
     omp_set_num_threads(num_threads);
     cout << "OpenMP threads: " << num_threads << endl;
     
-    // Process logs
+    // Process logs, one segment at a time when a memory limit is set
     cout << "\n[3/4] Processing logs..." << endl;
-    auto total_start = chrono::high_resolution_clock::now();
+    StatsAccumulator acc;
+    vector<ThreadAggregates> aggregates(num_threads, ThreadAggregates(agg_cfg));
+    unique_ptr<BurstDetector> bursts;
+    if (opts.burst_window_sec > 0) {
+        BurstDetector::Config cfg;
+        cfg.window_sec = opts.burst_window_sec;
+        cfg.min_count = (uint32_t)opts.burst_min_count;
+        bursts.reset(new BurstDetector(cfg));
+    }
+    unique_ptr<InvertedIndexBuilder> index;
+    if (opts.build_index) {
+        index.reset(new InvertedIndexBuilder(num_threads));
+    }
+    PipelineContext ctx{rule_engine, report_gen, aggregates, bursts.get(), index.get()};
+    ctx.dedup = opts.dedup;
+    unique_ptr<ResultStoreWriter> store;
+    CheckpointLog checkpoints;
+    CheckpointRecord checkpoint = {};
+    checkpoint.input_size = fileSize(opts.input_file);
+    double total_time = 0;
+    size_t row_offset = 0;
+    size_t segments = 0;
     
-    #pragma omp parallel for schedule(dynamic, 10)
-    for (size_t i = 0; i < logs.size(); i++) {
-        // Stage 1: Rule-based analysis
-        rule_engine.analyze(logs[i]);
-        
-        // Stage 2: Report generation
-        report_gen.generate(logs[i]);
+    if (resuming) {
+        // Cut the store back to the checkpoint, rebuild the aggregates
+        // for the committed rows, then continue with the next segment
+        store.reset(new ResultStoreWriter(store_file, resume_from.store_bytes, 
+                                          resume_from.store_blocks, block_rows));
+        if (!store->isOpen() || !replayCommitted(reader, store_file, resume_from, ctx, acc)) {
+            cerr << "Error: Cannot resume from " << checkpoint_file << endl;
+            return 1;
+        }
+        checkpoint = resume_from;
+        total_time = resume_from.processing_sec;
+        row_offset = resume_from.rows;
+        segments = resume_from.segments;
+        readSegment(reader, logs, segment_budget);
+        cout << "Replayed " << row_offset << " logs from " << store_file << endl;
+    }
+    if (opts.checkpoint && !checkpoints.open(checkpoint_file, resuming)) {
+        cerr << "Error: Cannot create " << checkpoint_file << endl;
+        return 1;
+    }
+    
+    // With --checkpoint, segments are written to the store by a background
+    // job while the next one is read and processed; `committing` holds the
+    // rows in flight. Plain spill runs append synchronously.
+    vector<LogEntry> committing;
+    future<bool> commit_job;
+    auto waitForCommit = [&]() {
+        if (!commit_job.valid()) return true;
+        auto wait_start = chrono::high_resolution_clock::now();
+        bool ok = commit_job.get();
+        auto wait_end = chrono::high_resolution_clock::now();
+        total_time += chrono::duration<double>(wait_end - wait_start).count();
+        return ok;
+    };
+    
+    while (true) {
+        total_time += processSegment(logs, ctx, row_offset);
+        segments++;
+        if (index) {
+            auto index_start = chrono::high_resolution_clock::now();
+            index->flushSegment(logs);
+            auto index_end = chrono::high_resolution_clock::now();
+            total_time += chrono::duration<double>(index_end - index_start).count();
+        }
+        acc.add(logs);
         
-        // Calculate total time
-        logs[i].total_time_ms = logs[i].stage1_time_ms + logs[i].stage2_time_ms;
+        // Everything fit in one segment: keep results in memory
+        if (reader.exhausted() && segments == 1 && !opts.store) break;
         
-        // Progress display (every 100 logs)
-        if (i % 100 == 0 && i > 0) {
-            #pragma omp critical
-            {
-                cout << "  Processed: " << i << "/" << logs.size() << endl;
+        if (!store) {
+            store.reset(new ResultStoreWriter(store_file, opts.store, rule_engine.labelNames(),
+                                              block_rows));
+            if (!store->isOpen()) {
+                cerr << "Error: Cannot create " << store_file << endl;
+                return 1;
             }
         }
+        if (!waitForCommit()) {
+            cerr << "Error: Cannot write checkpoint to " << checkpoint_file << endl;
+            return 1;
+        }
+        
+        row_offset += logs.size();
+        checkpoint.input_offset = reader.offset();
+        checkpoint.rows = row_offset;
+        checkpoint.segments = segments;
+        checkpoint.processing_sec = total_time;
+        if (opts.checkpoint) {
+            committing.swap(logs);
+            commit_job = async(launch::async, [&, checkpoint]() mutable {
+                store->append(committing);
+                if (!store->commit()) return false;
+                checkpoint.store_bytes = store->committedBytes();
+                checkpoint.store_blocks = store->blockCount();
+                return checkpoints.commit(checkpoint);
+            });
+        } else {
+            store->append(logs);
+        }
+        
+        if (reader.exhausted()) break;
+        if (readSegment(reader, logs, segment_budget) == 0) break;
+    }
+    if (!waitForCommit()) {
+        cerr << "Error: Cannot write checkpoint to " << checkpoint_file << endl;
+        return 1;
     }
-    
-    auto total_end = chrono::high_resolution_clock::now();
-    double total_time = chrono::duration<double>(total_end - total_start).count();
     
     cout << "Processing completed!" << endl;
+    if (segments > 1) {
+        cout << "Spilled " << acc.total_logs << " logs in " << segments 
+             << " segments" << endl;
+    }
+    
+    // Merge per-thread aggregates
+    ThreadAggregates& merged = aggregates[0];
+    for (size_t t = 1; t < aggregates.size(); t++) {
+        merged.merge(aggregates[t]);
+    }
     
     // Calculate and print statistics
     cout << "\n[4/4] Calculating statistics..." << endl;
-    PerformanceStats stats = calculateStats(logs, total_time, num_threads);
+    PerformanceStats stats = calculateStats(acc, total_time, num_threads);
+    stats.peak_memory_mb = peakMemoryMB();
+    stats.has_dedup = opts.dedup;
+    stats.has_ground_truth = true;
+    stats.parse_errors = reader.parseErrors();
+    merged.fillStats(stats);
     
     // Print statistics
     printStats(stats);
     
     // Print label distribution
-    printLabelDistribution(logs);
-
-    struct rusage usage;
-    getrusage(RUSAGE_SELF, &usage);
-    #ifdef __APPLE__
-        long memory_mb = usage.ru_maxrss / (1024 * 1024);  // Mac
-    #else
-        long memory_mb = usage.ru_maxrss / 1024;            // Linux
-    #endif
-
-    cout << "\n--- Memory Usage ---" << endl;
-    cout << "Peak memory: " << memory_mb << " MB" << endl;
+    printLabelDistribution(acc);
+    
+    // Print heavy hitters
+    printHeavyHitters(merged.heavy_hitters);
+    
+    // Print topology rollups
+    printTopologySummary(merged.topology);
     
     // Save results
     cout << "\n--- Saving Results ---" << endl;
-    saveStatsJSON(stats, output_dir + "scenario_d_performance.json");
-    saveDetailedResults(logs, output_dir + "scenario_d_results.csv");
+    saveStatsJSON(stats, merged, output_dir + "scenario_d_performance.json");
+    quarantine.flush();
+    if (quarantine.rowCount() > 0) {
+        cout << "Quarantined " << quarantine.rowCount() << " malformed rows to: " 
+             << quarantine_file << endl;
+    }
+    if (store) {
+        store->mergeInto(output_dir + "scenario_d_results.csv");
+    } else {
+        saveDetailedResults(logs, output_dir + "scenario_d_results.csv");
+    }
+    if (opts.store) {
+        cout << "Result store saved to: " << store_file 
+             << " (" << store->blockCount() << " blocks)" << endl;
+    }
+    if (merged.topology.enabled()) {
+        saveTopologyReport(merged.topology, rule_engine.labelNames(),
+                           output_dir + "scenario_d_topology.csv");
+    }
+    if (index) {
+        string index_file = output_dir + "scenario_d_index.bin";
+        if (index->save(index_file)) {
+            cout << "Inverted index saved to: " << index_file 
+                 << " (" << index->termCount() << " terms)" << endl;
+        } else {
+            cerr << "Error: Cannot write " << index_file << endl;
+        }
+    }
+    if (merged.cube.enabled()) {
+        string cube_file = output_dir + "scenario_d_cube.csv";
+        size_t cells = merged.cube.save(cube_file, rule_engine.labelNames());
+        cout << "Aggregate cube saved to: " << cube_file << " (" << cells << " cells";
+        if (merged.cube.untimedRows() > 0) {
+            cout << ", " << merged.cube.untimedRows() << " rows without timestamp";
+        }
+        cout << ")" << endl;
+    }
+    if (bursts) {
+        saveBurstAlerts(bursts->finish(), output_dir + "scenario_d_alerts.csv");
+        if (bursts->lateRows() > 0) {
+            cout << "Burst detector skipped " << bursts->lateRows() 
+                 << " rows arriving more than one window late" << endl;
+        }
+    }
     
     cout << "\n" << string(80, '=') << endl;
     cout << "EXPERIMENT COMPLETED" << endl;
@@ -637,4 +6019,5 @@ int main(int argc, char* argv[]) {
     
     
     return 0;
-}
\ No newline at end of file
+}
+#endif // SCENARIO_D_NO_MAIN